@@ -0,0 +1,231 @@
+#define MIDI_IO_IMPLEMENTATION
+#include <midi-io.h>
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_ARCHIVE_ZLIB
+#define MIDI_ARCHIVE_IMPLEMENTATION
+#include <midi-archive.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Scans the MIDI file, compressed stream or tar bundle named on the command line; Without arguments, packs a small
+ * song every supported way (plain, .mid.gz, .tar.gz, and with `make ZSTD=1` also .mid.zst and .tar.zst), and checks
+ * that each one scans. */
+
+/* parses one MIDI file at current position of the stream; tracks are parsed straight from the decompressed window */
+static int
+scan_smf (midi_archive_t *ma, const char *name)
+{
+    const uint8_t *data;
+    uint16_t format, ntracks, tickdiv;
+    uint32_t len;
+    unsigned long events = 0;
+    int tracks = 0, ret;
+
+    if (ma_smf_header (ma, &format, &ntracks, &tickdiv) != 0)
+    {
+        printf ("%s: not a MIDI file\n", name);
+        return -1;
+    }
+
+    while ((ret = ma_next_track (ma, &data, &len)) > 0)
+    {
+        track_parser_t tp = { 0 };
+        track_event_t ev = { 0 };
+
+        tp.bytes = data;
+        tp.len = len;
+        while (track_event_next (&tp, &ev) > 0) events += 1;
+        tracks += 1;
+    }
+
+    printf ("%s: format %hu, %d tracks, %lu events%s\n", name, format, tracks, events,
+            ret < 0 ? ", then truncated or corrupt" : "");
+    return ret;
+}
+
+/* scans every member of a tar bundle, or the whole stream; returns 0, or -1 if anything failed */
+static int
+scan (const midi_io_t *io, const char *path)
+{
+    midi_archive_t ma = { 0 };
+    char name[101];
+    int ret = 0;
+
+    if (ma_begin (&ma, io, MA_AUTO) != 0)
+    {
+        printf ("%s: can't decompress\n", path);
+        return -1;
+    }
+
+    if (ma_is_tar (&ma))
+    {
+        while ((ret = ma_next_member (&ma, name, NULL)) > 0)
+            if (scan_smf (&ma, name) != 0) ret = -1;
+        if (ret < 0) printf ("%s: truncated or corrupt archive\n", path);
+    }
+    else
+        ret = scan_smf (&ma, path);
+
+    ma_end (&ma);
+    return ret < 0 ? -1 : 0;
+}
+
+/* builds a format 1 file with a single track of a few notes */
+static uint32_t
+make_smf (uint8_t *out)
+{
+    static const uint8_t header[] = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 1, 0, 96 };
+    uint32_t n = sizeof header + 8, j;
+
+    memcpy (out, header, sizeof header);
+    for (j = 0; j < 8; ++j)
+    {
+        out[n] = 0x00; /* note on */
+        out[n + 1] = 0x90;
+        out[n + 2] = 60 + j;
+        out[n + 3] = 100;
+        out[n + 4] = 0x30; /* note off */
+        out[n + 5] = 0x80;
+        out[n + 6] = 60 + j;
+        out[n + 7] = 0;
+        n += 8;
+    }
+    memcpy (out + n, "\x00\xFF\x2F\x00", 4); /* end of track */
+    n += 4;
+
+    memcpy (out + sizeof header, "MTrk", 4);
+    out[sizeof header + 4] = 0;
+    out[sizeof header + 5] = 0;
+    out[sizeof header + 6] = (n - sizeof header - 8) >> 8;
+    out[sizeof header + 7] = n - sizeof header - 8;
+
+    return n;
+}
+
+/* builds a ustar bundle holding `len` bytes of `data` twice, as a.mid and b.mid */
+static uint32_t
+make_tar (uint8_t *out, const uint8_t *data, uint32_t len)
+{
+    uint32_t n = 0, sum, i;
+    int j;
+
+    for (j = 0; j < 2; ++j)
+    {
+        memset (out + n, 0, 512);
+        strcpy ((char *)out + n, j ? "b.mid" : "a.mid");
+        sprintf ((char *)out + n + 100, "%07o", 0644);
+        sprintf ((char *)out + n + 124, "%011lo", (unsigned long)len);
+        sprintf ((char *)out + n + 136, "%011o", 0);
+        out[n + 156] = '0';
+        memcpy (out + n + 257, "ustar\0" "00", 8);
+        memset (out + n + 148, ' ', 8);
+        for (i = sum = 0; i < 512; ++i) sum += out[n + i];
+        sprintf ((char *)out + n + 148, "%06lo", (unsigned long)sum);
+        n += 512;
+
+        memcpy (out + n, data, len);
+        memset (out + n + len, 0, (512 - len % 512) % 512);
+        n += len + (512 - len % 512) % 512;
+    }
+
+    memset (out + n, 0, 1024); /* end of archive */
+    return n + 1024;
+}
+
+static uint32_t
+make_gzip (uint8_t *out, uint32_t cap, const uint8_t *data, uint32_t len)
+{
+    z_stream z;
+    uint32_t n;
+
+    memset (&z, 0, sizeof z);
+    if (deflateInit2 (&z, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 0; /* 15 + 16: gzip */
+    z.next_in = (uint8_t *)data;
+    z.avail_in = len;
+    z.next_out = out;
+    z.avail_out = cap;
+    n = deflate (&z, Z_FINISH) == Z_STREAM_END ? cap - z.avail_out : 0;
+    deflateEnd (&z);
+
+    return n;
+}
+
+#ifdef MIDI_ARCHIVE_ZSTD
+static uint32_t
+make_zstd (uint8_t *out, uint32_t cap, const uint8_t *data, uint32_t len)
+{
+    size_t n = ZSTD_compress (out, cap, data, len, 3);
+    return ZSTD_isError (n) ? 0 : n;
+}
+#endif
+
+/* scans an in-memory stream; returns 0 if the outcome is the `expect`ed one, -1 otherwise */
+static int
+check (const char *name, const uint8_t *data, uint32_t len, int expect)
+{
+    midi_io_t io;
+    mio_mem_t m = { 0 };
+    int ret;
+
+    m.data = (uint8_t *)data;
+    m.len = m.cap = len;
+    mio_mem (&io, &m);
+
+    ret = scan (&io, name);
+    printf ("%s: %s\n", name, ret == expect ? "ok" : "UNEXPECTED");
+    return ret == expect ? 0 : -1;
+}
+
+static int
+run_cases (void)
+{
+    static uint8_t smf[256], tar[4096], packed[8192];
+    uint32_t smf_len, tar_len, n;
+    int failed = 0;
+
+    smf_len = make_smf (smf);
+    tar_len = make_tar (tar, smf, smf_len);
+
+    failed |= check ("song.mid", smf, smf_len, 0);
+    failed |= check ("cut.mid", smf, smf_len - 10, -1); /* ends inside the track */
+    failed |= check ("song.tar", tar, tar_len, 0);
+    failed |= check ("cut-member.tar", tar, 1024, 0);  /* ends between members - no end blocks, but not cut */
+    failed |= check ("cut-header.tar", tar, 1124, -1); /* ends inside the second header */
+
+    n = make_gzip (packed, sizeof packed, smf, smf_len);
+    failed |= check ("song.mid.gz", packed, n, 0);
+    failed |= check ("cut.mid.gz", packed, n - 12, -1); /* trailer and the end of the data gone */
+    n = make_gzip (packed, sizeof packed, tar, tar_len);
+    failed |= check ("song.tar.gz", packed, n, 0);
+    n = make_gzip (packed, sizeof packed, tar, 1124);
+    failed |= check ("cut-header.tar.gz", packed, n, -1);
+
+#ifdef MIDI_ARCHIVE_ZSTD
+    n = make_zstd (packed, sizeof packed, smf, smf_len);
+    failed |= check ("song.mid.zst", packed, n, 0);
+    n = make_zstd (packed, sizeof packed, tar, tar_len);
+    failed |= check ("song.tar.zst", packed, n, 0);
+    failed |= check ("cut.tar.zst", packed, n - 3, -1); /* frame cut short */
+#endif
+
+    return failed ? 1 : 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    FILE *f;
+    midi_io_t io;
+    int ret;
+
+    if (argc < 2) return run_cases ();
+
+    if ((f = fopen (argv[1], "rb")) == NULL) return 1;
+    mio_file (&io, f);
+    ret = scan (&io, argv[1]);
+    fclose (f);
+
+    return ret < 0;
+}
@@ -0,0 +1,101 @@
+/* Parser throughput benchmark
+ * Built twice by the makefile: `example-bench` with the checked parser, and `example-bench-trusted` with
+ * `MIDI_PARSER_TRUSTED_INPUT` - compare their output to see what the bounds checks cost. */
+
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TRACK_LEN (16 << 20)
+#define ROUNDS 8
+
+/* Fills `out` with a plausible mix of events: mostly notes (often with running status), some controllers and pitch
+ * bends, and a few meta and sysex events; returns number of bytes used */
+static uint32_t
+make_track (uint8_t *out, uint32_t cap)
+{
+    uint32_t seed = 12345, n = 0, r;
+    uint8_t status = 0;
+
+    while (n + 16 < cap)
+    {
+        seed = seed * 1103515245 + 12345;
+        r = seed >> 16;
+
+        n += midi_vlq_encode (r % 8 == 0 ? r % 1000 : r % 4, out + n);
+
+        if (r % 100 == 0)
+        {
+            out[n++] = 0xFF; /* tempo */
+            out[n++] = 0x51;
+            out[n++] = 3;
+            out[n++] = 0x07;
+            out[n++] = 0xA1;
+            out[n++] = 0x20;
+            status = 0;
+        }
+        else if (r % 100 == 1)
+        {
+            out[n++] = 0xF0; /* sysex */
+            out[n++] = 4;
+            out[n++] = 0x7E;
+            out[n++] = 0x7F;
+            out[n++] = 0x09;
+            out[n++] = 0xF7;
+            status = 0;
+        }
+        else
+        {
+            uint8_t st = (r % 10 < 8 ? 0x90 : r % 10 == 8 ? 0xB0 : 0xE0) | (r >> 8 & 3);
+
+            if (st != status) out[n++] = st;
+            status = st;
+            out[n++] = r >> 4 & 0x7F;
+            out[n++] = r >> 11 & 0x7F;
+        }
+    }
+
+    return n;
+}
+
+int
+main (void)
+{
+    uint8_t *track = malloc (TRACK_LEN);
+    uint32_t len, events = 0, round;
+    unsigned long sum = 0;
+    clock_t t;
+    double s;
+
+    if (track == NULL) return 1;
+    len = make_track (track, TRACK_LEN);
+
+    t = clock ();
+    for (round = 0; round < ROUNDS; ++round)
+    {
+        track_parser_t tp = { 0 };
+        track_event_t ev = { 0 };
+
+        tp.bytes = track;
+        tp.len = len;
+        while (tp.idx < tp.len && track_event_next (&tp, &ev) > 0)
+        {
+            sum += ev.delta; /* keeps the loop from being optimized out */
+            events += 1;
+        }
+    }
+    s = (double)(clock () - t) / CLOCKS_PER_SEC;
+
+#ifdef MIDI_PARSER_TRUSTED_INPUT
+    printf ("trusted: ");
+#else
+    printf ("checked: ");
+#endif
+    printf ("%.0f MB/s, %.1f M events/s (%lu)\n", (double)len * ROUNDS / s / 1e6, events / s / 1e6, sum);
+
+    free (track);
+    return 0;
+}
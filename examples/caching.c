@@ -0,0 +1,78 @@
+#define _GNU_SOURCE
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_IO_IMPLEMENTATION
+#include <midi-io.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_WRITER_IMPLEMENTATION
+#include <midi-writer.h>
+#define MIDI_TRANSFORM_IMPLEMENTATION
+#include <midi-transform.h>
+#define MIDI_PLAYER_IMPLEMENTATION
+#include <midi-player.h>
+#define MIDI_HASH_IMPLEMENTATION
+#include <midi-hash.h>
+#define MIDI_CACHE_IMPLEMENTATION
+#include <midi-cache.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#define THREADS 4
+#define LOOKUPS 1000000
+
+static midi_cache_t cache;
+static char **paths;
+static int npaths;
+
+/* Looks up the files over and over, like a server handling requests for them */
+static void *
+worker (void *arg)
+{
+    const mca_song_t *song;
+    unsigned long events = 0;
+    int j;
+
+    (void)arg;
+    for (j = 0; j < LOOKUPS; ++j)
+    {
+        if (mca_get (&cache, paths[j % npaths], &song) != 0) continue;
+        events += song->ntracks ? song->events[0].count : 0;
+        mca_release (song);
+    }
+
+    return (void *)events;
+}
+
+int
+main (int argc, char **argv)
+{
+    static char *def[] = { "output.mid" };
+    pthread_t threads[THREADS];
+    mca_stats_t stats;
+    struct timespec t0, t1;
+    double ns;
+    int j;
+
+    paths = argc > 1 ? argv + 1 : def;
+    npaths = argc > 1 ? argc - 1 : 1;
+
+    if (mca_begin (&cache, 64 << 20, 1000) != 0) return 1;
+
+    clock_gettime (CLOCK_MONOTONIC, &t0);
+    for (j = 0; j < THREADS; ++j) pthread_create (&threads[j], NULL, worker, NULL);
+    for (j = 0; j < THREADS; ++j) pthread_join (threads[j], NULL);
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+
+    mca_stats (&cache, &stats);
+    printf ("%d threads x %d lookups: %.0f ns per lookup\n", THREADS, LOOKUPS, ns / LOOKUPS);
+    printf ("hits %lu, misses %lu, stale %lu, evictions %lu, %u songs in %lu bytes\n", (unsigned long)stats.hits,
+            (unsigned long)stats.misses, (unsigned long)stats.stale, (unsigned long)stats.evictions, stats.songs,
+            (unsigned long)stats.bytes);
+
+    mca_end (&cache);
+    return 0;
+}
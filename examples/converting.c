@@ -0,0 +1,78 @@
+#define _GNU_SOURCE
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_IO_IMPLEMENTATION
+#include <midi-io.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_WRITER_IMPLEMENTATION
+#include <midi-writer.h>
+#define MIDI_PLAYER_IMPLEMENTATION
+#include <midi-player.h>
+#define MIDI_CONVERT_IMPLEMENTATION
+#include <midi-convert.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Converts format 0 files to format 1, and format 1 files to format 0 */
+int
+main (int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "output.mid";
+    const char *dst = argc > 2 ? argv[2] : "converted.mid";
+    FILE *midif, *dstf;
+    midi_reader_t mr = { 0 };
+    midi_io_t io;
+    uint8_t **tracks;
+    uint32_t *lens, ntracks = 0, tracklen, j;
+    int r;
+
+    if ((midif = fopen (path, "rb")) == NULL || mr_begin (&mr, midif) != 0)
+    {
+        printf ("%s: can't read\n", path);
+        return 1;
+    }
+    if (mr.format == MIDI_FMT_MSONG)
+    {
+        printf ("%s: format 2 (independent songs), not converted\n", path);
+        return 1;
+    }
+    if ((dstf = fopen (dst, "wb")) == NULL)
+    {
+        printf ("%s: can't write\n", dst);
+        return 1;
+    }
+
+    tracks = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *tracks);
+    lens = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *lens);
+    while (ntracks < mr.ntracks && (tracklen = mr_next_track (&mr)) > 0)
+    {
+        tracks[ntracks] = malloc (tracklen);
+        lens[ntracks] = tracklen;
+        if (mr_get_track_data (&mr, tracks[ntracks]) != 0) break;
+        ntracks += 1;
+    }
+
+    mio_file (&io, dstf);
+    if (mr.format == MIDI_FMT_SINGLE && ntracks == 1)
+    {
+        r = mc_split (&io, tracks[0], lens[0], mr.tickdiv);
+        printf ("%s: format 0 -> %s: format 1, %d tracks\n", path, dst, r);
+    }
+    else
+    {
+        r = mc_flatten (&io, (const uint8_t *const *)tracks, lens, ntracks, mr.tickdiv);
+        printf ("%s: format %u, %u tracks -> %s: format 0\n", path, mr.format, (unsigned)ntracks, dst);
+    }
+    if (r < 0) printf ("%s: can't convert\n", path);
+
+    for (j = 0; j < ntracks; ++j) free (tracks[j]);
+    free (tracks);
+    free (lens);
+    mr_end (&mr);
+    fclose (midif);
+    fclose (dstf);
+
+    return 0;
+}
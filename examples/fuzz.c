@@ -0,0 +1,132 @@
+/* Fuzz harness for the parser, reader, rewriter and batch transform
+ * libFuzzer:  clang -g -O1 -fsanitize=fuzzer,address,undefined -DFUZZ_LIBFUZZER -I.. fuzz.c -o fuzz && ./fuzz corpus/
+ * AFL:        afl-clang-fast -g -O1 -fsanitize=address -I.. fuzz.c -o fuzz && afl-fuzz -i corpus -o findings ./fuzz @@
+ * Without `FUZZ_LIBFUZZER`, this runs each file named on the command line (or stdin) once, so crashes found by either
+ * fuzzer can be replayed with any compiler. `make check` replays known crashers under AddressSanitizer. */
+
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_IO_IMPLEMENTATION
+#include <midi-io.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_REWRITER_IMPLEMENTATION
+#include <midi-rewriter.h>
+#define MIDI_TRANSFORM_IMPLEMENTATION
+#include <midi-transform.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Parses `len` bytes as track data; the buffer is exactly `len` bytes long, so the sanitizer sees any overread */
+static void
+fuzz_track (const uint8_t *data, uint32_t len)
+{
+    track_parser_t tp = { 0 };
+    track_event_t ev = { 0 };
+    midi_rewrite_t rw = { 0 };
+    midi_batch_t mb = { 0 };
+    uint8_t *copy;
+    uint32_t size;
+
+    tp.bytes = data;
+    tp.len = len;
+    while (tp.idx < tp.len && track_event_next (&tp, &ev) > 0)
+        ;
+
+    if ((copy = malloc (len ? len : 1)) == NULL) return;
+    memcpy (copy, data, len);
+    rw.flags = RW_DROP_SYSEX | RW_DROP_TEXT;
+    rw_track (&rw, copy, len, copy, len);
+    free (copy);
+
+    /* the batch points into `data`, so encoding it reads every payload back */
+    if (mb_load_track (&mb, data, len) > 0 && (copy = malloc ((size = mb_get_storage_size (&mb)) + 1)) != NULL)
+    {
+        mb_encode (&mb, copy, size);
+        free (copy);
+    }
+    mb_free (&mb);
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size);
+
+int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+    midi_reader_t mr = { 0 };
+    midi_io_t io;
+    mio_mem_t m = { 0 };
+    uint32_t tracklen;
+    uint8_t *evdata;
+
+    if (size > 0xFFFFFF) return 0;
+
+    /* as raw track data */
+    fuzz_track (data, size);
+
+    /* as a whole file */
+    m.data = (uint8_t *)data;
+    m.len = m.cap = size;
+    mio_mem (&io, &m);
+    if (mr_begin_io (&mr, &io) != 0) return 0;
+
+    while ((tracklen = mr_next_track (&mr)) > 0)
+    {
+        if ((evdata = malloc (tracklen)) == NULL) break;
+        if (mr_get_track_data (&mr, evdata) == 0) fuzz_track (evdata, tracklen);
+        free (evdata);
+    }
+    mr_end (&mr);
+
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+static void
+run (FILE *f)
+{
+    uint8_t *data = NULL, *p;
+    size_t len = 0, cap = 0, n;
+
+    for (;;)
+    {
+        if (len == cap)
+        {
+            cap = cap ? cap * 2 : 4096;
+            if ((p = realloc (data, cap)) == NULL) break;
+            data = p;
+        }
+        if ((n = fread (data + len, 1, cap - len, f)) == 0) break;
+        len += n;
+    }
+
+    /* exactly sized copy, for the sanitizer */
+    if ((p = malloc (len ? len : 1)) != NULL)
+    {
+        memcpy (p, data, len);
+        LLVMFuzzerTestOneInput (p, len);
+        free (p);
+    }
+    free (data);
+}
+
+int
+main (int argc, char **argv)
+{
+    FILE *f;
+    int j;
+
+    if (argc < 2) run (stdin);
+    for (j = 1; j < argc; ++j)
+    {
+        if ((f = fopen (argv[j], "rb")) == NULL) continue;
+        run (f);
+        fclose (f);
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_HASH_IMPLEMENTATION
+#include <midi-hash.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+main (int argc, char **argv)
+{
+    int j;
+
+    for (j = 1; j < (argc > 1 ? argc : 2); ++j)
+    {
+        const char *path = argc > 1 ? argv[j] : "output.mid";
+        FILE *midif;
+        midi_reader_t mr = { 0 };
+        mh_file_t fh;
+        uint32_t tracklen;
+        uint64_t th;
+
+        if ((midif = fopen (path, "rb")) == NULL || mr_begin (&mr, midif) != 0)
+        {
+            printf ("%s: can't read\n", path);
+            if (midif) fclose (midif);
+            continue;
+        }
+
+        mh_file_begin (&fh);
+        while ((tracklen = mr_next_track (&mr)) > 0)
+        {
+            uint8_t *evdata = malloc (tracklen);
+
+            if (mr_get_track_data (&mr, evdata) == 0 && mh_track (evdata, tracklen, 0, &th) == 0)
+                mh_file_add (&fh, th);
+            free (evdata);
+        }
+
+        printf ("%08lx%08lx  %s\n", (unsigned long)(mh_file_end (&fh) >> 32),
+                (unsigned long)(mh_file_end (&fh) & 0xFFFFFFFFUL), path);
+
+        mr_end (&mr);
+        fclose (midif);
+    }
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_IO_IMPLEMENTATION
+#include <midi-io.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_INDEX_IMPLEMENTATION
+#include <midi-index.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SHARD_DOCS 100 /* files per shard */
+
+static void
+run_query (const midi_index_t *idx, char **paths, const char *what, const uint32_t *keys, uint32_t nkeys)
+{
+    uint32_t docs[16], j;
+    int32_t n;
+
+    n = mi_search (idx, keys, nkeys, 4, docs, 16);
+    printf ("%s: %d file(s)\n", what, n);
+    for (j = 0; n > 0 && j < (uint32_t)n && j < 16; ++j) printf ("  %s\n", paths[docs[j]]);
+}
+
+int
+main (int argc, char **argv)
+{
+    mi_builder_t b = { 0 };
+    midi_index_t idx = { 0 };
+    midi_io_t io;
+    const uint8_t scale[] = { 60, 62, 64, 65, 67 };
+    uint32_t keys[8], nshards = 0, doc, j;
+    char name[32];
+    FILE *f;
+
+    if (argc < 2)
+    {
+        printf ("usage: %s file.mid...\n", argv[0]);
+        return 1;
+    }
+
+    /* build - document ids are positions in argv, starting from 1 */
+    for (doc = 1; doc < (uint32_t)argc; ++doc)
+    {
+        FILE *midif;
+        midi_reader_t mr = { 0 };
+        uint32_t tracklen;
+
+        if ((midif = fopen (argv[doc], "rb")) != NULL && mr_begin (&mr, midif) == 0)
+        {
+            while ((tracklen = mr_next_track (&mr)) > 0)
+            {
+                uint8_t *evdata = malloc (tracklen);
+
+                if (mr_get_track_data (&mr, evdata) != 0 || mi_add_track (&b, doc, evdata, tracklen) != 0)
+                    printf ("%s: skipping a track\n", argv[doc]);
+                free (evdata);
+            }
+            mr_end (&mr);
+        }
+        else
+            printf ("%s: can't read\n", argv[doc]);
+        if (midif) fclose (midif);
+
+        if (doc % SHARD_DOCS == 0 || doc + 1 == (uint32_t)argc)
+        {
+            sprintf (name, "index-%03u.midx", (unsigned)nshards++);
+            if ((f = fopen (name, "wb")) == NULL) return 1;
+            mio_file (&io, f);
+            if (mi_builder_write (&b, &io) != 0) printf ("%s: can't write\n", name);
+            fclose (f);
+        }
+    }
+    mi_builder_free (&b);
+
+    /* query */
+    for (j = 0; j < nshards; ++j)
+    {
+        sprintf (name, "index-%03u.midx", (unsigned)j);
+        if (mi_index_add (&idx, name) != 0) printf ("%s: can't open\n", name);
+    }
+
+    keys[0] = MI_KEY_PROGRAM (9, 0x19);
+    run_query (&idx, argv, "program 0x19 on channel 10", keys, 1);
+
+    keys[0] = MI_KEY_PROGRAM (0, 0);
+    keys[1] = MI_KEY_META (0x51);
+    run_query (&idx, argv, "piano on channel 1, with tempo changes", keys, 2);
+
+    run_query (&idx, argv, "pitches 60 62 64 65 67", keys, mi_pitch_keys (scale, 5, keys));
+
+    mi_index_end (&idx);
+    return 0;
+}
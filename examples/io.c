@@ -0,0 +1,68 @@
+#define MIDI_IO_IMPLEMENTATION
+#include <midi-io.h>
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_WRITER_IMPLEMENTATION
+#include <midi-writer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int
+write_song (midi_writer_t *mw)
+{
+    uint8_t notes[] = { 0x00, 0x90, 60, 100, 0x00, 64, 100, 0x60, 60, 0, 0x00, 64, 0, 0x00, 0xFF, 0x2F, 0x00 };
+    int j;
+
+    for (j = 0; j < 2; ++j)
+    {
+        if (mw_track_begin (mw) != 0) return -1;
+        if (mw_track_append (mw, notes, sizeof notes) != 0) return -1;
+        if (mw_track_end (mw) != 0) return -1;
+    }
+
+    return mw_end (mw);
+}
+
+int
+main (void)
+{
+    midi_io_t io;
+    midi_writer_t mw = { 0 };
+    midi_reader_t mr = { 0 };
+    mio_mem_t seekable = { 0 }, stream = { 0 };
+    uint32_t tracklen;
+
+    /* seekable memory buffer - same as writing a file */
+    seekable.grow = 1;
+    mio_mem (&io, &seekable);
+    if (mw_begin_io (&mw, &io, MIDI_FMT_MTRACK, 96) != 0 || write_song (&mw) != 0) return 1;
+
+    /* same song, into a destination that can't seek (think pipe or socket) */
+    stream.grow = 1;
+    mio_mem (&io, &stream);
+    io.seek = NULL;
+    if (mw_begin_stream (&mw, &io, MIDI_FMT_MTRACK, 2, 96) != 0 || write_song (&mw) != 0) return 1;
+
+    printf ("seekable: %u bytes, stream: %u bytes, %s\n", seekable.len, stream.len,
+            seekable.len == stream.len && memcmp (seekable.data, stream.data, stream.len) == 0 ? "identical"
+                                                                                             : "different");
+
+    /* read it back straight from memory */
+    stream.off = 0;
+    mio_mem (&io, &stream);
+    if (mr_begin_io (&mr, &io) != 0) return 1;
+    printf ("Format: %hu, Track count: %hu, Timing interval: %hu\n", mr.format, mr.ntracks, mr.tickdiv);
+    while ((tracklen = mr_next_track (&mr)) > 0)
+    {
+        printf ("Track %d: %u bytes\n", mr.track_idx + 1, tracklen);
+        mr_get_track_data (&mr, NULL);
+    }
+    mr_end (&mr);
+
+    free (seekable.data);
+    free (stream.data);
+    return 0;
+}
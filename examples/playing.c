@@ -0,0 +1,74 @@
+#define _GNU_SOURCE
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_PLAYER_IMPLEMENTATION
+#include <midi-player.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* local sink - prints channel events as they are due */
+static int
+on_events (void *user, const mp_event_t *evs, uint32_t n)
+{
+    uint32_t j;
+
+    (void)user;
+    for (j = 0; j < n; ++j)
+    {
+        if (evs[j].ev.kind != EV_MIDI) continue;
+        printf ("<%06u> track %02u  k: %1X c: %1X d: %02X %02X\n", evs[j].tick, evs[j].track, evs[j].ev.as.midi.kind,
+                evs[j].ev.as.midi.channel, evs[j].ev.as.midi.as.bytes[0], evs[j].ev.as.midi.as.bytes[1]);
+    }
+
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "output.mid";
+    FILE *midif;
+    midi_reader_t mr = { 0 };
+    midi_player_t mp = { 0 };
+    uint8_t **tracks;
+    uint32_t *lens, ntracks = 0, tracklen, j;
+
+    if ((midif = fopen (path, "rb")) == NULL || mr_begin (&mr, midif) != 0)
+    {
+        printf ("%s: can't read\n", path);
+        return 1;
+    }
+
+    tracks = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *tracks);
+    lens = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *lens);
+    while (ntracks < mr.ntracks && (tracklen = mr_next_track (&mr)) > 0)
+    {
+        tracks[ntracks] = malloc (tracklen);
+        lens[ntracks] = tracklen;
+        if (mr_get_track_data (&mr, tracks[ntracks]) != 0) break;
+        ntracks += 1;
+    }
+
+    mp.out = on_events;
+    mp.spin_ns = 200000;    /* sleep until 0.2 ms before each deadline, then spin */
+    mp.resync_ns = 50000000; /* don't rush to catch up after a 50 ms stall */
+
+    if (mp_begin (&mp, (const uint8_t *const *)tracks, lens, ntracks, mr.tickdiv) != 0 || mp_play (&mp) != 0)
+        printf ("%s: can't play\n", path);
+
+    printf ("%u events in %u batches, lateness: mean %lu ns, max %lu ns, %u resync(s)\n", mp.stats.events,
+            mp.stats.batches, (unsigned long)(mp.stats.batches ? mp.stats.late_sum_ns / mp.stats.batches : 0),
+            (unsigned long)mp.stats.late_max_ns, mp.stats.resyncs);
+
+    mp_end (&mp);
+    for (j = 0; j < ntracks; ++j) free (tracks[j]);
+    free (tracks);
+    free (lens);
+    mr_end (&mr);
+    fclose (midif);
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#define _GNU_SOURCE
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_IO_IMPLEMENTATION
+#include <midi-io.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_PLAYER_IMPLEMENTATION
+#include <midi-player.h>
+#define MIDI_RENDER_IMPLEMENTATION
+#include <midi-render.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static midi_synth_t ms;
+
+int
+main (int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "output.mid";
+    const char *wav = argc > 2 ? argv[2] : "output.wav";
+    FILE *midif, *wavf;
+    midi_reader_t mr = { 0 };
+    midi_io_t io;
+    uint8_t **tracks;
+    uint32_t *lens, ntracks = 0, tracklen, j;
+    int32_t frames;
+    clock_t t;
+
+    if ((midif = fopen (path, "rb")) == NULL || mr_begin (&mr, midif) != 0)
+    {
+        printf ("%s: can't read\n", path);
+        return 1;
+    }
+    if ((wavf = fopen (wav, "wb")) == NULL)
+    {
+        printf ("%s: can't write\n", wav);
+        return 1;
+    }
+
+    tracks = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *tracks);
+    lens = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *lens);
+    while (ntracks < mr.ntracks && (tracklen = mr_next_track (&mr)) > 0)
+    {
+        tracks[ntracks] = malloc (tracklen);
+        lens[ntracks] = tracklen;
+        if (mr_get_track_data (&mr, tracks[ntracks]) != 0) break;
+        ntracks += 1;
+    }
+
+    /* 3 minute preview */
+    t = clock ();
+    mio_file (&io, wavf);
+    ms_begin (&ms, 44100);
+    frames = ms_render_file (&ms, (const uint8_t *const *)tracks, lens, ntracks, mr.tickdiv, 180 * 44100, &io);
+    t = clock () - t;
+
+    if (frames < 0)
+        printf ("%s: can't render\n", path);
+    else
+        printf ("%s: %.1f s of audio in %.1f ms\n", wav, frames / 44100.0, t * 1000.0 / CLOCKS_PER_SEC);
+
+    for (j = 0; j < ntracks; ++j) free (tracks[j]);
+    free (tracks);
+    free (lens);
+    mr_end (&mr);
+    fclose (midif);
+    fclose (wavf);
+
+    return 0;
+}
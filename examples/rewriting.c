@@ -0,0 +1,51 @@
+#define MIDI_REWRITER_IMPLEMENTATION
+#include <midi-rewriter.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+main (int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "output.mid";
+    const char *out_path = "rewritten.mid";
+    FILE *midif;
+    midi_rewrite_t rw = { 0 };
+    uint8_t chmap[16];
+    uint8_t *data;
+    long len;
+    int32_t n;
+    int j;
+
+    midif = fopen (path, "rb");
+    if (midif == NULL) return 1;
+    fseek (midif, 0, SEEK_END);
+    len = ftell (midif);
+    fseek (midif, 0, SEEK_SET);
+    data = malloc (len);
+    if (fread (data, 1, len, midif) != (size_t)len) return 1;
+    fclose (midif);
+
+    /* strip sysex and text, and swap channels 1 and 2 */
+    for (j = 0; j < 16; ++j) chmap[j] = j;
+    chmap[0] = 1;
+    chmap[1] = 0;
+
+    rw.flags = RW_DROP_SYSEX | RW_DROP_TEXT;
+    rw.channel_map = chmap;
+
+    if ((n = rw_file (&rw, data, len)) < 0)
+    {
+        fprintf (stderr, "%s: malformed MIDI file\n", path);
+        return 1;
+    }
+
+    printf ("%s: %ld -> %d bytes\n", path, len, n);
+
+    midif = fopen (out_path, "wb");
+    fwrite (data, 1, n, midif);
+    fclose (midif);
+
+    free (data);
+    return 0;
+}
@@ -0,0 +1,80 @@
+#define _GNU_SOURCE
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_IO_IMPLEMENTATION
+#include <midi-io.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_WRITER_IMPLEMENTATION
+#include <midi-writer.h>
+#define MIDI_SPLICE_IMPLEMENTATION
+#include <midi-splice.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_TRACKS 0xFFFF
+
+static sp_track_t tracks[MAX_TRACKS];
+
+/* Concatenates tracks of all input files into a single format 1 file;
+ * "file.mid@ticks" delays every track of that file by `ticks` */
+int
+main (int argc, char **argv)
+{
+    const char *dst = argc > 1 ? argv[1] : "spliced.mid";
+    midi_reader_t mr = { 0 };
+    uint32_t ntracks = 0, delta, j;
+    uint16_t tickdiv = 0;
+    int32_t n;
+    char path[4096], *at;
+    int fd, out, i;
+
+    if (argc < 3)
+    {
+        printf ("usage: %s output.mid input.mid[@ticks] ...\n", argv[0]);
+        return 1;
+    }
+
+    for (i = 2; i < argc; ++i)
+    {
+        strncpy (path, argv[i], sizeof path - 1);
+        path[sizeof path - 1] = 0;
+        delta = 0;
+        if ((at = strrchr (path, '@')) != NULL)
+        {
+            *at = 0;
+            delta = strtoul (at + 1, NULL, 10);
+        }
+
+        if ((fd = open (path, O_RDONLY)) < 0 || (n = sp_scan (fd, &mr, tracks + ntracks, MAX_TRACKS - ntracks)) < 0)
+        {
+            printf ("%s: can't read\n", path);
+            return 1;
+        }
+        if ((uint32_t)n > MAX_TRACKS - ntracks)
+        {
+            printf ("%s: too many tracks\n", path);
+            return 1;
+        }
+
+        if (tickdiv == 0) tickdiv = mr.tickdiv;
+        if (mr.tickdiv != tickdiv) printf ("%s: tickdiv %u differs from %u\n", path, mr.tickdiv, tickdiv);
+        for (j = 0; j < (uint32_t)n; ++j) tracks[ntracks + j].delta = delta;
+        ntracks += n;
+    }
+
+    if ((out = open (dst, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0
+        || sp_write (out, MIDI_FMT_MTRACK, tickdiv, tracks, ntracks) != 0)
+    {
+        printf ("%s: can't write\n", dst);
+        return 1;
+    }
+    printf ("%s: %u tracks\n", dst, (unsigned)ntracks);
+
+    close (out);
+    return 0;
+}
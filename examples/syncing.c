@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_IO_IMPLEMENTATION
+#include <midi-io.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_PLAYER_IMPLEMENTATION
+#include <midi-player.h>
+#define MIDI_SYNC_IMPLEMENTATION
+#include <midi-sync.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MSGS 256
+
+static sy_msg_t msgs[MSGS];
+static uint8_t bytes[MSGS * 4];
+
+/* Sends the song with MIDI clock and 25 fps MTC to a raw MIDI device (e.g. /dev/snd/midiC1D0) in real time;
+ * without a device, prints the start of the stream */
+int
+main (int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "output.mid";
+    FILE *midif;
+    midi_reader_t mr = { 0 };
+    midi_sync_t sy = { 0 };
+    uint8_t **tracks;
+    uint32_t *lens, ntracks = 0, tracklen, j, k;
+    unsigned long total = 0, clocks = 0, frames = 0;
+    struct timespec start, at;
+    uint64_t ns;
+    int32_t n;
+    int dev = -1;
+
+    if ((midif = fopen (path, "rb")) == NULL || mr_begin (&mr, midif) != 0)
+    {
+        printf ("%s: can't read\n", path);
+        return 1;
+    }
+    if (argc > 2 && (dev = open (argv[2], O_WRONLY)) < 0)
+    {
+        printf ("%s: can't open\n", argv[2]);
+        return 1;
+    }
+
+    tracks = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *tracks);
+    lens = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *lens);
+    while (ntracks < mr.ntracks && (tracklen = mr_next_track (&mr)) > 0)
+    {
+        tracks[ntracks] = malloc (tracklen);
+        lens[ntracks] = tracklen;
+        if (mr_get_track_data (&mr, tracks[ntracks]) != 0) break;
+        ntracks += 1;
+    }
+
+    if (sy_begin (&sy, (const uint8_t *const *)tracks, lens, ntracks, mr.tickdiv, SY_CLOCK | SY_MTC, SY_MTC_25) != 0)
+    {
+        printf ("%s: can't sync\n", path);
+        return 1;
+    }
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    while ((n = sy_fill (&sy, msgs, MSGS, bytes, sizeof bytes)) > 0)
+    {
+        for (j = 0; j < (uint32_t)n; ++j)
+        {
+            clocks += msgs[j].data[0] == SY_MSG_CLOCK;
+            frames += msgs[j].data[0] == SY_MSG_QUARTER_FRAME;
+
+            if (dev >= 0)
+            {
+                ns = start.tv_nsec + msgs[j].ns;
+                at.tv_sec = start.tv_sec + ns / 1000000000;
+                at.tv_nsec = ns % 1000000000;
+                while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL) != 0)
+                    ;
+                if (write (dev, msgs[j].data, msgs[j].len) < 0) return 1;
+            }
+            else if (total + j < 40)
+            {
+                printf ("%10.3f ms:", msgs[j].ns / 1e6);
+                for (k = 0; k < msgs[j].len && k < 8; ++k) printf (" %02X", msgs[j].data[k]);
+                printf ("\n");
+            }
+        }
+        total += n;
+    }
+    if (n < 0) printf ("%s: malformed event\n", path);
+    printf ("%lu messages, %lu clocks, %lu quarter frames\n", total, clocks, frames);
+
+    sy_end (&sy);
+    for (j = 0; j < ntracks; ++j) free (tracks[j]);
+    free (tracks);
+    free (lens);
+    mr_end (&mr);
+    fclose (midif);
+    if (dev >= 0) close (dev);
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#define MIDI_TRANSFORM_IMPLEMENTATION
+#include <midi-transform.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NUM_NOTES 200000
+
+/* builds a track of `NUM_NOTES` slightly off-grid notes, and returns its length */
+static uint32_t
+make_track (uint8_t *out)
+{
+    uint32_t n = 0;
+    int j;
+
+    for (j = 0; j < NUM_NOTES; ++j)
+    {
+        n += midi_vlq_encode (j == 0 ? 0 : 3, out + n);
+        out[n++] = 0x90 | (j % 16);
+        out[n++] = 36 + j % 48;
+        out[n++] = 1 + j % 127;
+        n += midi_vlq_encode (20 + j % 7, out + n);
+        out[n++] = 0x80 | (j % 16);
+        out[n++] = 36 + j % 48;
+        out[n++] = 0;
+    }
+
+    out[n++] = 0x00;
+    out[n++] = 0xFF;
+    out[n++] = 0x2F;
+    out[n++] = 0x00;
+
+    return n;
+}
+
+int
+main (void)
+{
+    const char *path = "output.mid";
+    FILE *midif;
+    midi_writer_t mw = { 0 };
+    midi_batch_t mb = { 0 };
+    uint8_t *track, *out;
+    uint8_t curve[128], map[16];
+    uint32_t len, n;
+    clock_t t0, total;
+    int j;
+
+    track = malloc (NUM_NOTES * 16);
+    out = malloc (NUM_NOTES * 16);
+    len = make_track (track);
+
+    for (j = 0; j < 128; ++j) curve[j] = j * j / 127; /* simple exponential-ish curve */
+    for (j = 0; j < 16; ++j) map[j] = 15 - j;
+
+    /* bulk edit: decode once, run kernels over columns, encode once */
+    total = t0 = clock ();
+    mb_load_track (&mb, track, len);
+    printf ("batch load:    %u events in %.2f ms\n", mb.count, (clock () - t0) * 1000.0 / CLOCKS_PER_SEC);
+
+    t0 = clock ();
+    mb_transpose (&mb, 2, MIDI_BATCH_ALL_CHANNELS & ~(1 << 9));
+    mb_remap_channels (&mb, map);
+    mb_velocity_curve (&mb, curve, MIDI_BATCH_ALL_CHANNELS);
+    mb_quantize (&mb, 24, 192, MIDI_BATCH_ALL_CHANNELS);
+    mb_scale_time (&mb, 0x18000);
+    mb_sort (&mb);
+    printf ("batch edit:    %.2f ms\n", (clock () - t0) * 1000.0 / CLOCKS_PER_SEC);
+
+    t0 = clock ();
+    n = mb_encode (&mb, out, NUM_NOTES * 16);
+    printf ("batch encode:  %u bytes in %.2f ms\n", n, (clock () - t0) * 1000.0 / CLOCKS_PER_SEC);
+    printf ("batch total:   %.2f ms (load + edit + encode)\n", (clock () - total) * 1000.0 / CLOCKS_PER_SEC);
+
+    /* the same edits (without quantize), one event at a time */
+    t0 = clock ();
+    {
+        track_parser_t tp = { 0 };
+        track_event_t ev = { 0 };
+        int note;
+
+        tp.bytes = track;
+        tp.len = len;
+        n = 0;
+
+        while (track_event_next (&tp, &ev) > 0)
+        {
+            if (ev.kind == EV_MIDI)
+            {
+                midi_event_t *e = &ev.as.midi;
+                if ((e->kind == MIDI_NOTE_ON || e->kind == MIDI_NOTE_OFF) && e->channel != 9)
+                {
+                    note = e->as.note_on.note + 2;
+                    e->as.note_on.note = note > 127 ? 127 : note;
+                }
+                if (e->kind == MIDI_NOTE_ON && e->as.note_on.velocity)
+                    e->as.note_on.velocity = curve[e->as.note_on.velocity] ? curve[e->as.note_on.velocity] : 1;
+                e->channel = map[e->channel];
+            }
+            ev.delta = ev.delta * 3 / 2;
+            n += track_event_to_bytes (&ev, out + n);
+        }
+    }
+    printf ("round trip:    %u bytes in %.2f ms\n", n, (clock () - t0) * 1000.0 / CLOCKS_PER_SEC);
+
+    midif = fopen (path, "wb");
+    mw_begin (&mw, midif, MIDI_FMT_SINGLE, 96);
+    mw_track_begin (&mw);
+    mb_write_track (&mb, &mw);
+    mw_track_end (&mw);
+    mw_end (&mw);
+    fclose (midif);
+
+    mb_free (&mb);
+    free (track);
+    free (out);
+    return 0;
+}
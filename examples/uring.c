@@ -0,0 +1,82 @@
+#define _GNU_SOURCE
+#define MIDI_PARSER_IMPLEMENTATION
+#include <midi-parser.h>
+#define MIDI_IO_IMPLEMENTATION
+#include <midi-io.h>
+#define MIDI_READER_IMPLEMENTATION
+#include <midi-reader.h>
+#define MIDI_URING_IMPLEMENTATION
+#include <midi-uring.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* runs once per file, as soon as the whole file is in memory */
+static void
+on_read (mu_file_t *f, int status)
+{
+    midi_reader_t mr = { 0 };
+    midi_io_t io;
+    mio_mem_t m = { 0 };
+    uint32_t tracklen;
+    unsigned long events = 0;
+
+    if (status != 0)
+    {
+        printf ("%s: read failed\n", f->path);
+        return;
+    }
+
+    m.data = f->data;
+    m.len = m.cap = f->len;
+    mio_mem (&io, &m);
+
+    if (mr_begin_io (&mr, &io) != 0)
+    {
+        printf ("%s: not a MIDI file\n", f->path);
+        return;
+    }
+
+    while ((tracklen = mr_next_track (&mr)) > 0)
+    {
+        track_parser_t tp = { 0 };
+        track_event_t ev = { 0 };
+
+        /* track data is already in memory - parse it in place */
+        tp.bytes = f->data + mr.i;
+        tp.len = tracklen;
+        while (track_event_next (&tp, &ev) > 0) events += 1;
+
+        mr_get_track_data (&mr, NULL);
+    }
+
+    printf ("%s: %u bytes, %d tracks, %lu events\n", f->path, f->len, mr.track_idx + 1, events);
+    mr_end (&mr);
+}
+
+int
+main (int argc, char **argv)
+{
+    midi_uring_t mu = { 0 };
+    mu_file_t *files;
+    int nfiles = argc > 1 ? argc - 1 : 1;
+    int j, failed;
+
+    files = calloc (nfiles, sizeof *files);
+
+    mu_begin (&mu, 64);
+    printf ("using %s\n", mu.ring_fd >= 0 ? "io_uring" : "pread");
+
+    for (j = 0; j < nfiles; ++j)
+    {
+        files[j].path = argc > 1 ? argv[j + 1] : "output.mid";
+        files[j].done = on_read;
+        mu_read (&mu, &files[j]);
+    }
+
+    failed = mu_run (&mu);
+    mu_end (&mu);
+
+    free (files);
+    return failed != 0;
+}
@@ -0,0 +1,559 @@
+/* MIDI-archive - MIDI files from compressed streams and tar bundles, without temp files
+ * This header decompresses a stream (gzip with zlib, zstd with libzstd, or plain) into a sliding window, walks tar
+ * members if the stream is a tar archive, and hands out MIDI track data as spans pointing straight into the window.
+ * Codecs are optional: define `MIDI_ARCHIVE_ZLIB` (and link with -lz) and / or `MIDI_ARCHIVE_ZSTD` (and link with
+ * -lzstd) before including the implementation. Plain (uncompressed) streams and tar walking need no library.
+ * The decompressed stream can also be read through `ma_io`, e.g. with `mr_begin_io`.
+
+ * Example usage
+
+ ```c
+ midi_archive_t ma = { 0 };
+ midi_io_t io;
+ char name[101];
+ const uint8_t *data;
+ uint16_t format, ntracks, tickdiv;
+ uint32_t len;
+
+ mio_file (&io, fopen ("corpus.tar.zst", "rb"));
+ ma_begin (&ma, &io, MA_AUTO);
+
+ while (ma_next_member (&ma, name, NULL) > 0)
+ {
+     if (ma_smf_header (&ma, &format, &ntracks, &tickdiv) != 0) continue;
+     while (ma_next_track (&ma, &data, &len) > 0)
+     {
+         // ... `data` points to `len` bytes of event data, valid until the next ma_* call ...
+     }
+ }
+
+ ma_end (&ma);
+ ```
+ */
+
+#ifndef MIDI_ARCHIVE_H
+#define MIDI_ARCHIVE_H
+
+#include "midi-io.h"
+
+#include <stdint.h>
+
+#define MA_AUTO 0  /* detect codec from stream magic */
+#define MA_PLAIN 1 /* not compressed */
+#define MA_GZIP 2  /* gzip / zlib (needs MIDI_ARCHIVE_ZLIB) */
+#define MA_ZSTD 3  /* zstd (needs MIDI_ARCHIVE_ZSTD) */
+
+#define MA_MAX_SPAN (64U << 20) /* default limit for the longest span (track) handed out */
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    midi_io_t src; /* compressed source */
+    int codec;     /* MA_PLAIN, MA_GZIP or MA_ZSTD */
+    int src_eof;   /* 1 - no more compressed input; 0 otherwise */
+    int dec_eof;   /* 1 - no more decompressed output; 0 otherwise */
+    int dec_open;  /* 1 - the codec is inside a gzip member / zstd frame, so input must not end yet; 0 otherwise */
+    void *dec;     /* codec state */
+    /* compressed input buffer */
+    uint8_t *in;
+    uint32_t in_start, in_end, in_cap;
+    /* decompressed window; bytes between `win_start` and `win_end` are not consumed yet */
+    uint8_t *win;
+    uint32_t win_start, win_end, win_cap;
+    uint32_t max_span; /* longest span handed out; MA_MAX_SPAN if 0 */
+    /* tar state */
+    int in_tar;           /* 1 - `ma_next_member` has been called; 0 otherwise */
+    uint32_t member_left; /* bytes left in current tar member */
+    uint32_t member_pad;  /* padding after current tar member */
+} midi_archive_t;
+
+/* Initializes the context, reading compressed data from `src` (copied into the context; only `src->read` is used);
+ * On success returns 0;
+ * On failure (NULL argument, codec not compiled in, allocation or read failed) returns -1. */
+int ma_begin (midi_archive_t *ma, const midi_io_t *src, int codec);
+
+/* Frees buffers and codec state. Doesn't close the source. */
+void ma_end (midi_archive_t *ma);
+
+/* Returns 1 if the decompressed stream looks like a tar archive (checks the first header); 0 otherwise. */
+int ma_is_tar (midi_archive_t *ma);
+
+/* Moves to the next regular file in a tar archive, skipping what's left of the current one;
+ * From now on, reads stop at the end of the member. `out_name` (101 bytes, may be NULL) receives the member name,
+ * `out_size` (may be NULL) its size;
+ * On success returns 1; At end of archive (zero block, or end of stream before the next header) returns 0;
+ * On failure (malformed or partial header, truncated compressed stream, read failed) returns -1. */
+int ma_next_member (midi_archive_t *ma, char *out_name, uint32_t *out_size);
+
+/* Consumes the next `len` bytes of the decompressed stream (or tar member), and points `out_data` at them;
+ * The span lives in the window, and is valid until the next ma_* call;
+ * On success returns 0;
+ * On failure (stream ends early, `len` above `max_span`, read or decompression failed) returns -1. */
+int ma_span (midi_archive_t *ma, uint32_t len, const uint8_t **out_data);
+
+/* Parses MIDI file header at current position;
+ * On success fills out header info and returns 0;
+ * On failure (not a MIDI header, stream ended) returns -1. */
+int ma_smf_header (midi_archive_t *ma, uint16_t *out_format, uint16_t *out_ntracks, uint16_t *out_tickdiv);
+
+/* Moves to the next track chunk (skipping other chunks), and points `out_data` at its event data, in the window;
+ * On success stores the track length in bytes (may be 0) in `out_len`, and returns 1;
+ * At end of stream / member (before any byte of the next chunk) returns 0;
+ * On failure (partial or oversized chunk, truncated compressed stream, read or decompression failed, NULL argument)
+ * returns -1. */
+int ma_next_track (midi_archive_t *ma, const uint8_t **out_data, uint32_t *out_len);
+
+/* Fills `io` with a `read` callback returning decompressed data (stopping at end of tar member). */
+void ma_io (midi_archive_t *ma, midi_io_t *io);
+
+#ifdef MIDI_ARCHIVE_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef MIDI_ARCHIVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MIDI_ARCHIVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define _MA_IN_SIZE (64U << 10)
+
+/* Refills compressed input buffer; returns number of new bytes, 0 at end of source, -1 on failure */
+static int32_t
+_ma_refill (midi_archive_t *ma)
+{
+    int32_t n;
+
+    if (ma->src_eof) return 0;
+    if (ma->in_start == ma->in_end) ma->in_start = ma->in_end = 0;
+    if (ma->in_end == ma->in_cap)
+    {
+        memmove (ma->in, ma->in + ma->in_start, ma->in_end - ma->in_start);
+        ma->in_end -= ma->in_start;
+        ma->in_start = 0;
+    }
+
+    n = ma->src.read (ma->src.ctx, ma->in + ma->in_end, ma->in_cap - ma->in_end);
+    if (n < 0) return -1;
+    if (n == 0) ma->src_eof = 1;
+    ma->in_end += n;
+
+    return n;
+}
+
+/* Decompresses into free space at the end of the window; returns number of new bytes, 0 at end, -1 on failure */
+static int32_t
+_ma_produce (midi_archive_t *ma)
+{
+    uint32_t room = ma->win_cap - ma->win_end;
+    uint32_t n;
+
+    if (ma->dec_eof) return 0;
+
+    for (;;)
+    {
+        if (ma->in_start == ma->in_end)
+        {
+            if (_ma_refill (ma) < 0) return -1;
+            if (ma->in_start == ma->in_end && ma->codec == MA_PLAIN)
+            {
+                ma->dec_eof = 1;
+                return 0;
+            }
+        }
+
+        switch (ma->codec)
+        {
+        case MA_PLAIN:
+            n = ma->in_end - ma->in_start < room ? ma->in_end - ma->in_start : room;
+            memcpy (ma->win + ma->win_end, ma->in + ma->in_start, n);
+            ma->in_start += n;
+            ma->win_end += n;
+            return n;
+#ifdef MIDI_ARCHIVE_ZLIB
+        case MA_GZIP:
+        {
+            z_stream *z = ma->dec;
+            int ret;
+
+            z->next_in = ma->in + ma->in_start;
+            z->avail_in = ma->in_end - ma->in_start;
+            z->next_out = ma->win + ma->win_end;
+            z->avail_out = room;
+
+            ret = inflate (z, Z_NO_FLUSH);
+            n = room - z->avail_out;
+            ma->in_start = ma->in_end - z->avail_in;
+            ma->win_end += n;
+
+            if (ret == Z_STREAM_END)
+            {
+                /* concatenated gzip members continue the stream */
+                if (inflateReset (z) != Z_OK) return -1;
+            }
+            else if (ret != Z_OK && ret != Z_BUF_ERROR)
+                return -1;
+            ma->dec_open = z->total_in != 0; /* `inflateReset` clears it at the end of each member */
+
+            if (n > 0) return n;
+            break;
+        }
+#endif
+#ifdef MIDI_ARCHIVE_ZSTD
+        case MA_ZSTD:
+        {
+            ZSTD_inBuffer zin;
+            ZSTD_outBuffer zout;
+            size_t ret;
+
+            zin.src = ma->in + ma->in_start;
+            zin.size = ma->in_end - ma->in_start;
+            zin.pos = 0;
+            zout.dst = ma->win + ma->win_end;
+            zout.size = room;
+            zout.pos = 0;
+
+            /* concatenated frames continue the stream, as with gzip */
+            ret = ZSTD_decompressStream (ma->dec, &zout, &zin);
+            if (ZSTD_isError (ret)) return -1;
+            ma->dec_open = ret != 0; /* 0 - frame fully decoded and flushed */
+
+            ma->in_start += zin.pos;
+            ma->win_end += zout.pos;
+            if (zout.pos > 0) return zout.pos;
+            break;
+        }
+#endif
+        default: return -1;
+        }
+
+        /* nothing came out, and nothing more will go in */
+        if (ma->in_start == ma->in_end && ma->src_eof)
+        {
+            if (ma->dec_open) return -1; /* member / frame cut short */
+            ma->dec_eof = 1;
+            return 0;
+        }
+    }
+}
+
+/* Makes sure `len` unconsumed bytes are in the window; returns 0 or -1 */
+static int
+_ma_ensure (midi_archive_t *ma, uint32_t len)
+{
+    uint32_t cap;
+    int32_t n;
+    void *p;
+
+    if (ma->win_end - ma->win_start >= len) return 0;
+    if (len > (ma->max_span ? ma->max_span : MA_MAX_SPAN)) return -1;
+
+    /* slide the window, so there's room after the unconsumed bytes */
+    memmove (ma->win, ma->win + ma->win_start, ma->win_end - ma->win_start);
+    ma->win_end -= ma->win_start;
+    ma->win_start = 0;
+
+    if (len > ma->win_cap)
+    {
+        for (cap = ma->win_cap; cap < len; cap *= 2);
+        if ((p = realloc (ma->win, cap)) == NULL) return -1;
+        ma->win = p;
+        ma->win_cap = cap;
+    }
+
+    while (ma->win_end < len)
+        if ((n = _ma_produce (ma)) <= 0) return -1;
+
+    return 0;
+}
+
+int
+ma_begin (midi_archive_t *ma, const midi_io_t *src, int codec)
+{
+    if (ma == NULL || src == NULL || src->read == NULL) return -1;
+
+    memset (ma, 0, sizeof *ma);
+    ma->src = *src;
+    ma->in_cap = _MA_IN_SIZE;
+    ma->win_cap = 4 * _MA_IN_SIZE;
+    ma->in = malloc (ma->in_cap);
+    ma->win = malloc (ma->win_cap);
+    if (ma->in == NULL || ma->win == NULL) goto error;
+
+    if (codec == MA_AUTO)
+    {
+        while (ma->in_end < 4 && !ma->src_eof)
+            if (_ma_refill (ma) < 0) goto error;
+
+        codec = MA_PLAIN;
+        if (ma->in_end >= 2 && ma->in[0] == 0x1F && ma->in[1] == 0x8B) codec = MA_GZIP;
+        if (ma->in_end >= 4 && ma->in[0] == 0x28 && ma->in[1] == 0xB5 && ma->in[2] == 0x2F && ma->in[3] == 0xFD)
+            codec = MA_ZSTD;
+    }
+    ma->codec = codec;
+
+    switch (codec)
+    {
+    case MA_PLAIN: break;
+#ifdef MIDI_ARCHIVE_ZLIB
+    case MA_GZIP:
+        if ((ma->dec = calloc (1, sizeof (z_stream))) == NULL) goto error;
+        if (inflateInit2 ((z_stream *)ma->dec, 15 + 32) != Z_OK) /* 15 + 32: gzip or zlib header */
+        {
+            free (ma->dec);
+            ma->dec = NULL;
+            goto error;
+        }
+        break;
+#endif
+#ifdef MIDI_ARCHIVE_ZSTD
+    case MA_ZSTD:
+        if ((ma->dec = ZSTD_createDStream ()) == NULL) goto error;
+        if (ZSTD_isError (ZSTD_initDStream (ma->dec))) goto error;
+        break;
+#endif
+    default: goto error;
+    }
+
+    return 0;
+error:
+    ma_end (ma);
+    return -1;
+}
+
+void
+ma_end (midi_archive_t *ma)
+{
+    if (ma == NULL) return;
+
+    if (ma->dec)
+    {
+#ifdef MIDI_ARCHIVE_ZLIB
+        if (ma->codec == MA_GZIP)
+        {
+            inflateEnd (ma->dec);
+            free (ma->dec);
+        }
+#endif
+#ifdef MIDI_ARCHIVE_ZSTD
+        if (ma->codec == MA_ZSTD) ZSTD_freeDStream (ma->dec);
+#endif
+    }
+
+    free (ma->in);
+    free (ma->win);
+    ma->dec = NULL;
+    ma->in = ma->win = NULL;
+}
+
+/* Consumes `len` bytes of the raw decompressed stream, ignoring member boundaries */
+static int
+_ma_take (midi_archive_t *ma, uint32_t len, const uint8_t **out_data)
+{
+    if (_ma_ensure (ma, len) != 0) return -1;
+    if (out_data) *out_data = ma->win + ma->win_start;
+    ma->win_start += len;
+    return 0;
+}
+
+/* Discards `len` bytes of the raw decompressed stream, without holding them in the window all at once */
+static int
+_ma_discard (midi_archive_t *ma, uint32_t len)
+{
+    uint32_t n;
+
+    while (len > 0)
+    {
+        n = len < ma->win_cap ? len : ma->win_cap;
+        if (_ma_take (ma, n, NULL) != 0) return -1;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Returns 1 if the stream ended cleanly, with every decompressed byte consumed; 0 otherwise */
+static int
+_ma_at_end (const midi_archive_t *ma)
+{
+    return ma->dec_eof && ma->win_start == ma->win_end;
+}
+
+static int
+_ma_is_tar_header (const uint8_t *h)
+{
+    return memcmp (h + 257, "ustar", 5) == 0;
+}
+
+int
+ma_is_tar (midi_archive_t *ma)
+{
+    if (ma == NULL || _ma_ensure (ma, 512) != 0) return 0;
+    return _ma_is_tar_header (ma->win + ma->win_start);
+}
+
+static int
+_ma_octal (const uint8_t *b, int len, uint32_t *out)
+{
+    uint32_t v = 0;
+    int i = 0;
+
+    while (i < len && b[i] == ' ') ++i;
+    for (; i < len && b[i] >= '0' && b[i] <= '7'; ++i)
+    {
+        if (v > (0xFFFFFFFFU >> 3)) return -1;
+        v = v << 3 | (b[i] - '0');
+    }
+
+    *out = v;
+    return 0;
+}
+
+int
+ma_next_member (midi_archive_t *ma, char *out_name, uint32_t *out_size)
+{
+    const uint8_t *h;
+    uint32_t size;
+    int i;
+
+    if (ma == NULL) return -1;
+
+    /* size and padding are discarded one after the other, as their sum may not fit 32 bits */
+    if (ma->in_tar && (_ma_discard (ma, ma->member_left) != 0 || _ma_discard (ma, ma->member_pad) != 0)) return -1;
+    ma->in_tar = 1;
+    ma->member_left = ma->member_pad = 0;
+
+    for (;;)
+    {
+        if (_ma_take (ma, 512, &h) != 0) return _ma_at_end (ma) ? 0 : -1;
+
+        for (i = 0; i < 512 && h[i] == 0; ++i);
+        if (i == 512) return 0; /* zero block - end of archive */
+
+        if (!_ma_is_tar_header (h) && memcmp (h + 257, "\0\0\0\0\0", 5) != 0) return -1;
+        if (h[124] & 0x80) return -1; /* base-256 size - member over 8GB */
+        if (_ma_octal (h + 124, 12, &size) != 0) return -1;
+
+        if (h[156] == '0' || h[156] == '\0') /* regular file */
+        {
+            if (out_name)
+            {
+                memcpy (out_name, h, 100);
+                out_name[100] = '\0';
+            }
+            if (out_size) *out_size = size;
+
+            ma->member_left = size;
+            ma->member_pad = (512 - size % 512) % 512;
+            return 1;
+        }
+
+        /* directories, links, pax headers, ... */
+        if (_ma_discard (ma, size) != 0 || _ma_discard (ma, (512 - size % 512) % 512) != 0) return -1;
+    }
+}
+
+int
+ma_span (midi_archive_t *ma, uint32_t len, const uint8_t **out_data)
+{
+    if (ma == NULL) return -1;
+    if (ma->in_tar && len > ma->member_left) return -1;
+    if (_ma_take (ma, len, out_data) != 0) return -1;
+    if (ma->in_tar) ma->member_left -= len;
+    return 0;
+}
+
+static uint32_t
+_ma_u32 (const uint8_t *b)
+{
+    return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8 | b[3];
+}
+
+int
+ma_smf_header (midi_archive_t *ma, uint16_t *out_format, uint16_t *out_ntracks, uint16_t *out_tickdiv)
+{
+    const uint8_t *h;
+    uint32_t header_len;
+
+    if (ma_span (ma, 8, &h) != 0) return -1;
+    if (_ma_u32 (h) != 0x4d546864) return -1;
+    if ((header_len = _ma_u32 (h + 4)) < 6) return -1;
+    if (ma_span (ma, header_len, &h) != 0) return -1;
+
+    if (out_format) *out_format = h[0] << 8 | h[1];
+    if (out_ntracks) *out_ntracks = h[2] << 8 | h[3];
+    if (out_tickdiv) *out_tickdiv = h[4] << 8 | h[5];
+
+    return 0;
+}
+
+int
+ma_next_track (midi_archive_t *ma, const uint8_t **out_data, uint32_t *out_len)
+{
+    const uint8_t *h;
+    uint32_t len;
+
+    if (ma == NULL || out_data == NULL || out_len == NULL) return -1;
+
+    for (;;)
+    {
+        if (ma->in_tar && ma->member_left == 0) return 0;
+        if (ma->in_tar && ma->member_left < 8) return -1; /* partial chunk header */
+        if (ma_span (ma, 8, &h) != 0) return _ma_at_end (ma) ? 0 : -1;
+
+        len = _ma_u32 (h + 4);
+        if (_ma_u32 (h) == 0x4D54726B) break;
+
+        /* alien chunk */
+        if (ma->in_tar && len > ma->member_left) return -1;
+        if (_ma_discard (ma, len) != 0) return -1;
+        if (ma->in_tar) ma->member_left -= len;
+    }
+
+    if (ma_span (ma, len, out_data) != 0) return -1;
+    *out_len = len;
+
+    return 1;
+}
+
+static int32_t
+_ma_io_read (void *ctx, uint8_t *buf, uint32_t len)
+{
+    midi_archive_t *ma = ctx;
+    uint32_t n;
+    int32_t r;
+
+    if (ma->in_tar && len > ma->member_left) len = ma->member_left;
+    if (len == 0) return 0;
+
+    if (ma->win_start == ma->win_end)
+    {
+        ma->win_start = ma->win_end = 0;
+        if ((r = _ma_produce (ma)) <= 0) return r;
+    }
+
+    n = ma->win_end - ma->win_start < len ? ma->win_end - ma->win_start : len;
+    memcpy (buf, ma->win + ma->win_start, n);
+    ma->win_start += n;
+    if (ma->in_tar) ma->member_left -= n;
+
+    return n;
+}
+
+void
+ma_io (midi_archive_t *ma, midi_io_t *io)
+{
+    if (io == NULL) return;
+
+    io->read = _ma_io_read;
+    io->write = NULL;
+    io->seek = NULL;
+    io->size = NULL;
+    io->ctx = ma;
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
@@ -0,0 +1,552 @@
+/* MIDI-cache - thread-safe in-process cache of decoded MIDI files
+ * `mca_get` hands out a decoded, immutable song for a path: track data, every event decoded into a `midi_batch_t`
+ * (see midi-transform) and the tempo map (see `mp_tempo_scan` in midi-player). Songs are loaded on first use, and kept
+ * until the memory budget runs out, least recently used first.
+ * Songs are keyed by path, and tied to the identity of the file they were loaded from (device, inode, size and
+ * modification time): a changed file is loaded again. To keep hits away from the filesystem, the identity is checked
+ * at most once per `recheck_ms` for each song; 0 checks it on every lookup.
+ * The cache is split into MCA_SHARDS shards by path hash, each with its own lock, LRU list and share of the budget, so
+ * threads looking up different files rarely wait on each other. Files are loaded outside of any lock.
+ * Songs are reference counted - every song returned by `mca_get` must be handed back with `mca_release`, and stays
+ * valid until then, even if it's evicted (or its file changes) in the meantime.
+ * The implementation uses POSIX APIs (pthreads) - compile it with `_GNU_SOURCE` defined before any system header, and
+ * link with `-pthread`.
+
+ * Example usage
+
+ ```c
+ midi_cache_t cache = { 0 };
+ const mca_song_t *song;
+
+ mca_begin (&cache, 256 << 20, 1000); // 256 MB, files checked once a second
+
+ // ... from any thread ...
+ if (mca_get (&cache, "songs/popular.mid", &song) == 0)
+ {
+     // ... song->events[t] are the events of track t, song->tempo maps ticks to time ...
+     mca_release (song);
+ }
+
+ mca_end (&cache);
+ ```
+ */
+
+#ifndef MIDI_CACHE_H
+#define MIDI_CACHE_H
+
+#include "midi-hash.h"
+#include "midi-io.h"
+#include "midi-parser.h"
+#include "midi-player.h"
+#include "midi-reader.h"
+#include "midi-transform.h"
+
+#include <stdint.h>
+
+#define MCA_SHARDS 16 /* number of independently locked parts of the cache */
+
+struct _mca_shard;
+
+/* Decoded file; Never modified while it's handed out */
+typedef struct mca_song
+{
+    uint16_t format;
+    uint16_t ntracks; /* number of tracks read */
+    uint16_t tickdiv;
+    uint8_t **tracks;     /* event data of each track */
+    uint32_t *lens;       /* length of event data of each track */
+    midi_batch_t *events; /* decoded events of each track; payloads point into `tracks` */
+    mp_tempo_t tempo;     /* tempo map of the whole file */
+    uint64_t size;        /* bytes of memory held by the song */
+    /* internal state */
+    uint8_t *data; /* whole file */
+    char *path;
+    uint64_t key;                          /* hash of `path` */
+    uint64_t dev, ino, fsize, mtime;       /* identity of the file */
+    uint64_t checked_ns;                   /* last time the identity was checked */
+    uint32_t refs;                         /* references handed out, not released yet */
+    int cached;                            /* 1 - in the hash table and LRU list; 0 - freed on last release */
+    struct _mca_shard *shard;              /* shard of `path` */
+    struct mca_song *hnext, *prev, *next; /* hash chain; LRU list, most recently used first */
+} mca_song_t;
+
+typedef struct
+{
+    uint64_t hits;      /* lookups served from the cache */
+    uint64_t misses;    /* lookups that loaded the file */
+    uint64_t stale;     /* songs dropped because their file changed */
+    uint64_t evictions; /* songs dropped to stay within the budget */
+    uint64_t bytes;     /* memory held by cached songs */
+    uint32_t songs;     /* number of cached songs */
+} mca_stats_t;
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    struct _mca_shard *shards;
+    uint64_t budget;     /* memory budget of each shard */
+    uint64_t recheck_ns; /* how often the identity of a cached file is checked */
+} midi_cache_t;
+
+/* Initializes an empty cache, keeping up to about `budget` bytes of songs; Each shard gets an equal share of it, and
+ * songs larger than a share are handed out, but never cached. File identity is checked at most once per `recheck_ms`;
+ * On success returns 0;
+ * On failure (NULL argument, out of memory, mutex initialization failed) returns -1. */
+int mca_begin (midi_cache_t *c, uint64_t budget, uint32_t recheck_ms);
+
+/* Finds the song of file `path`, loading and decoding it if it isn't cached, or if the file changed; The song must be
+ * handed back with `mca_release`;
+ * On success stores the song in `out_song`, and returns 0;
+ * On failure (I/O error, invalid file, malformed event, NULL argument, out of memory) returns -1. */
+int mca_get (midi_cache_t *c, const char *path, const mca_song_t **out_song);
+
+/* Releases a song returned by `mca_get`; It must not be used afterwards. */
+void mca_release (const mca_song_t *song);
+
+/* Stores counters, summed over all shards, in `out_stats`. */
+void mca_stats (midi_cache_t *c, mca_stats_t *out_stats);
+
+/* Frees all cached songs, and the cache itself; All songs must be released first. */
+void mca_end (midi_cache_t *c);
+
+#ifdef MIDI_CACHE_IMPLEMENTATION
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define _MCA_BUCKETS 64 /* initial hash table size of a shard */
+
+struct _mca_shard
+{
+    pthread_mutex_t lock;
+    mca_song_t **buckets;
+    uint32_t nbuckets;
+    mca_song_t *head, *tail; /* LRU list */
+    uint64_t budget;
+    mca_stats_t stats;
+};
+
+static uint64_t
+_mca_now (void)
+{
+    struct timespec ts;
+
+    if (clock_gettime (CLOCK_MONOTONIC, &ts) != 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+_mca_free (mca_song_t *song)
+{
+    uint32_t t;
+
+    if (song->events)
+        for (t = 0; t < song->ntracks; ++t) mb_free (&song->events[t]);
+    mp_tempo_end (&song->tempo);
+    free (song->events);
+    free (song->tracks);
+    free (song->lens);
+    free (song->data);
+    free (song->path);
+    free (song);
+}
+
+/* Reads the whole file into memory, and decodes it; returns NULL on failure */
+static mca_song_t *
+_mca_load (const char *path)
+{
+    mca_song_t *song;
+    midi_reader_t mr = { 0 };
+    mio_mem_t m = { 0 };
+    midi_io_t io;
+    struct stat st;
+    uint32_t len, t, off = 0;
+    ssize_t n;
+    int fd;
+
+    if ((fd = open (path, O_RDONLY)) < 0) return NULL;
+    if (fstat (fd, &st) != 0 || st.st_size <= 0 || st.st_size > 0xFFFFFFFF || (song = calloc (1, sizeof *song)) == NULL)
+    {
+        close (fd);
+        return NULL;
+    }
+
+    song->dev = st.st_dev;
+    song->ino = st.st_ino;
+    song->fsize = st.st_size;
+    song->mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+    if ((song->data = malloc (st.st_size)) != NULL)
+        while (off < song->fsize && (n = pread (fd, song->data + off, song->fsize - off, off)) > 0) off += n;
+    close (fd);
+    if (song->data == NULL || off != song->fsize) goto fail;
+
+    m.data = song->data;
+    m.len = m.cap = song->fsize;
+    mio_mem (&io, &m);
+    if (mr_begin_io (&mr, &io) != 0) goto fail;
+
+    song->format = mr.format;
+    song->tickdiv = mr.tickdiv;
+    song->tracks = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *song->tracks);
+    song->lens = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *song->lens);
+    song->events = calloc (mr.ntracks ? mr.ntracks : 1, sizeof *song->events);
+    if (song->tracks == NULL || song->lens == NULL || song->events == NULL) goto fail;
+
+    /* tracks point into the file, only the events are decoded */
+    while (song->ntracks < mr.ntracks && (len = mr_next_track (&mr)) > 0)
+    {
+        t = song->ntracks++;
+        song->tracks[t] = song->data + mr.i;
+        song->lens[t] = len;
+        if (mr_get_track_data (&mr, NULL) != 0) goto fail;
+        if (mb_load_track (&song->events[t], song->tracks[t], len) < 0) goto fail;
+    }
+    mr_end (&mr);
+
+    if (mp_tempo_begin (&song->tempo, song->tickdiv) != 0) goto fail;
+    if (mp_tempo_scan (&song->tempo, (const uint8_t *const *)song->tracks, song->lens, song->ntracks) != 0) goto fail;
+    if ((song->path = malloc (strlen (path) + 1)) == NULL) goto fail;
+    strcpy (song->path, path);
+
+    song->size = sizeof *song + song->fsize + strlen (path) + 1;
+    song->size += (uint64_t)song->ntracks * (sizeof *song->tracks + sizeof *song->lens + sizeof *song->events);
+    song->size += (uint64_t)song->tempo.cap * sizeof *song->tempo.segs;
+    for (t = 0; t < song->ntracks; ++t)
+        song->size += (uint64_t)song->events[t].capacity
+                      * (sizeof *song->events[t].tick + 3 + sizeof *song->events[t].payload
+                         + sizeof *song->events[t].length);
+
+    return song;
+
+fail:
+    _mca_free (song);
+    return NULL;
+}
+
+/* 1 if `song` was loaded from the file `st` describes; 0 otherwise */
+static int
+_mca_same (const mca_song_t *song, const struct stat *st)
+{
+    return song->dev == (uint64_t)st->st_dev && song->ino == (uint64_t)st->st_ino
+           && song->fsize == (uint64_t)st->st_size
+           && song->mtime == (uint64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/* Finds cached song of `path`; called with the shard locked */
+static mca_song_t *
+_mca_find (struct _mca_shard *s, uint64_t key, const char *path)
+{
+    mca_song_t *song;
+
+    for (song = s->buckets[key & (s->nbuckets - 1)]; song; song = song->hnext)
+        if (song->key == key && strcmp (song->path, path) == 0) return song;
+    return NULL;
+}
+
+/* Moves a cached song to the front of the LRU list; called with the shard locked */
+static void
+_mca_touch (struct _mca_shard *s, mca_song_t *song)
+{
+    if (s->head == song) return;
+
+    song->prev->next = song->next;
+    if (song->next)
+        song->next->prev = song->prev;
+    else
+        s->tail = song->prev;
+
+    song->prev = NULL;
+    song->next = s->head;
+    s->head->prev = song;
+    s->head = song;
+}
+
+/* Removes a song from the hash table and LRU list, and pushes it to `*freed` if nobody holds it; called with the shard
+ * locked */
+static void
+_mca_unlink (struct _mca_shard *s, mca_song_t *song, mca_song_t **freed)
+{
+    mca_song_t **p = &s->buckets[song->key & (s->nbuckets - 1)];
+
+    while (*p != song) p = &(*p)->hnext;
+    *p = song->hnext;
+
+    if (song->prev)
+        song->prev->next = song->next;
+    else
+        s->head = song->next;
+    if (song->next)
+        song->next->prev = song->prev;
+    else
+        s->tail = song->prev;
+
+    song->cached = 0;
+    s->stats.songs -= 1;
+    s->stats.bytes -= song->size;
+
+    if (song->refs == 0)
+    {
+        song->hnext = *freed;
+        *freed = song;
+    }
+}
+
+/* Adds a song to the hash table and the front of the LRU list, then evicts songs from the back of the list until the
+ * shard fits its budget; called with the shard locked */
+static void
+_mca_insert (struct _mca_shard *s, mca_song_t *song, mca_song_t **freed)
+{
+    mca_song_t **buckets, *next, *victim;
+    uint32_t j, b;
+
+    /* grow the table at load factor 1 - on failure, chains just get longer */
+    if (s->stats.songs >= s->nbuckets && (buckets = calloc (s->nbuckets * 2, sizeof *buckets)) != NULL)
+    {
+        for (j = 0; j < s->nbuckets; ++j)
+            for (victim = s->buckets[j]; victim; victim = next)
+            {
+                next = victim->hnext;
+                b = victim->key & (s->nbuckets * 2 - 1);
+                victim->hnext = buckets[b];
+                buckets[b] = victim;
+            }
+        free (s->buckets);
+        s->buckets = buckets;
+        s->nbuckets *= 2;
+    }
+
+    b = song->key & (s->nbuckets - 1);
+    song->hnext = s->buckets[b];
+    s->buckets[b] = song;
+
+    song->prev = NULL;
+    song->next = s->head;
+    if (s->head)
+        s->head->prev = song;
+    else
+        s->tail = song;
+    s->head = song;
+
+    song->cached = 1;
+    s->stats.songs += 1;
+    s->stats.bytes += song->size;
+
+    while (s->stats.bytes > s->budget && (victim = s->tail) != song)
+    {
+        _mca_unlink (s, victim, freed);
+        s->stats.evictions += 1;
+    }
+}
+
+static void
+_mca_free_list (mca_song_t *song)
+{
+    mca_song_t *next;
+
+    for (; song; song = next)
+    {
+        next = song->hnext;
+        _mca_free (song);
+    }
+}
+
+int
+mca_begin (midi_cache_t *c, uint64_t budget, uint32_t recheck_ms)
+{
+    uint32_t j;
+
+    if (c == NULL) return -1;
+    if ((c->shards = calloc (MCA_SHARDS, sizeof *c->shards)) == NULL) return -1;
+
+    c->budget = budget / MCA_SHARDS;
+    c->recheck_ns = (uint64_t)recheck_ms * 1000000;
+
+    for (j = 0; j < MCA_SHARDS; ++j)
+    {
+        c->shards[j].budget = c->budget;
+        c->shards[j].nbuckets = _MCA_BUCKETS;
+        if ((c->shards[j].buckets = calloc (_MCA_BUCKETS, sizeof *c->shards[j].buckets)) == NULL
+            || pthread_mutex_init (&c->shards[j].lock, NULL) != 0)
+        {
+            free (c->shards[j].buckets);
+            while (j-- > 0)
+            {
+                pthread_mutex_destroy (&c->shards[j].lock);
+                free (c->shards[j].buckets);
+            }
+            free (c->shards);
+            c->shards = NULL;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+mca_get (midi_cache_t *c, const char *path, const mca_song_t **out_song)
+{
+    struct _mca_shard *s;
+    mca_song_t *song, *other, *freed = NULL;
+    struct stat st;
+    uint64_t key, now;
+
+    if (c == NULL || c->shards == NULL || path == NULL || out_song == NULL) return -1;
+
+    key = mh_xxh64 (path, strlen (path), 0);
+    s = &c->shards[(key >> 32) % MCA_SHARDS]; /* buckets use the low bits, so shards take theirs from the high half */
+    now = _mca_now ();
+
+    pthread_mutex_lock (&s->lock);
+    if ((song = _mca_find (s, key, path)) != NULL)
+    {
+        song->refs += 1;
+        if (now - song->checked_ns < c->recheck_ns)
+        {
+            _mca_touch (s, song);
+            s->stats.hits += 1;
+            pthread_mutex_unlock (&s->lock);
+            *out_song = song;
+            return 0;
+        }
+    }
+    pthread_mutex_unlock (&s->lock);
+
+    /* due for a check - the reference taken above keeps the song alive meanwhile */
+    if (song)
+    {
+        int same = stat (path, &st) == 0 && _mca_same (song, &st);
+
+        pthread_mutex_lock (&s->lock);
+        if (same)
+        {
+            song->checked_ns = now;
+            if (song->cached) _mca_touch (s, song);
+            s->stats.hits += 1;
+            pthread_mutex_unlock (&s->lock);
+            *out_song = song;
+            return 0;
+        }
+        if (song->cached)
+        {
+            _mca_unlink (s, song, &freed);
+            s->stats.stale += 1;
+        }
+        if (--song->refs == 0 && !song->cached)
+        {
+            song->hnext = freed;
+            freed = song;
+        }
+        pthread_mutex_unlock (&s->lock);
+        _mca_free_list (freed);
+        freed = NULL;
+    }
+
+    song = _mca_load (path);
+
+    pthread_mutex_lock (&s->lock);
+    s->stats.misses += 1;
+    if (song == NULL)
+    {
+        pthread_mutex_unlock (&s->lock);
+        return -1;
+    }
+    song->key = key;
+    song->checked_ns = now;
+    song->shard = s;
+    song->refs = 1;
+
+    /* another thread may have loaded the same file meanwhile */
+    if ((other = _mca_find (s, key, path)) != NULL)
+    {
+        if (other->dev == song->dev && other->ino == song->ino && other->fsize == song->fsize
+            && other->mtime == song->mtime)
+        {
+            other->refs += 1;
+            _mca_touch (s, other);
+            pthread_mutex_unlock (&s->lock);
+            _mca_free (song);
+            *out_song = other;
+            return 0;
+        }
+        _mca_unlink (s, other, &freed);
+        s->stats.stale += 1;
+    }
+    if (song->size <= s->budget) _mca_insert (s, song, &freed);
+    pthread_mutex_unlock (&s->lock);
+
+    _mca_free_list (freed);
+    *out_song = song;
+    return 0;
+}
+
+void
+mca_release (const mca_song_t *song)
+{
+    mca_song_t *p = (mca_song_t *)song;
+    int last;
+
+    if (p == NULL) return;
+
+    pthread_mutex_lock (&p->shard->lock);
+    last = --p->refs == 0 && !p->cached;
+    pthread_mutex_unlock (&p->shard->lock);
+
+    if (last) _mca_free (p);
+}
+
+void
+mca_stats (midi_cache_t *c, mca_stats_t *out_stats)
+{
+    struct _mca_shard *s;
+    uint32_t j;
+
+    if (out_stats == NULL) return;
+    memset (out_stats, 0, sizeof *out_stats);
+    if (c == NULL || c->shards == NULL) return;
+
+    for (j = 0; j < MCA_SHARDS; ++j)
+    {
+        s = &c->shards[j];
+        pthread_mutex_lock (&s->lock);
+        out_stats->hits += s->stats.hits;
+        out_stats->misses += s->stats.misses;
+        out_stats->stale += s->stats.stale;
+        out_stats->evictions += s->stats.evictions;
+        out_stats->bytes += s->stats.bytes;
+        out_stats->songs += s->stats.songs;
+        pthread_mutex_unlock (&s->lock);
+    }
+}
+
+void
+mca_end (midi_cache_t *c)
+{
+    mca_song_t *song, *next;
+    uint32_t j;
+
+    if (c == NULL || c->shards == NULL) return;
+
+    for (j = 0; j < MCA_SHARDS; ++j)
+    {
+        for (song = c->shards[j].head; song; song = next)
+        {
+            next = song->next;
+            _mca_free (song);
+        }
+        pthread_mutex_destroy (&c->shards[j].lock);
+        free (c->shards[j].buckets);
+    }
+    free (c->shards);
+    c->shards = NULL;
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
@@ -0,0 +1,281 @@
+/* MIDI-convert - conversion between format 0 and format 1 files
+ * `mc_flatten` merges the tracks of a format 1 file into the single track of a format 0 file, and `mc_split` splits
+ * the track of a format 0 file into a format 1 file: a conductor track (meta and sysex events) followed by one track
+ * per channel used. Format 2 files hold independent songs, which don't merge into one - callers should reject them.
+ * Events are never decoded into an intermediate representation: deltas are rebased on the fly, channel events are
+ * re-encoded with running status, and meta / sysex events are copied straight from the source track, long ones without
+ * any intermediate copy. Each track ends with a single end of track event, at the end of the song.
+ * `mc_flatten` is a single pass over the tracks, with memory bounded by the number of tracks (see `mp_merge_begin` in
+ * midi-player). `mc_split` sizes the output tracks in a first pass, then fills a single buffer of exactly that size -
+ * as output tracks interleave in the input, they can't be written one after another in a single pass otherwise.
+ * Output goes through `midi-writer.h`; if `io` can't seek, the writer buffers each track (see `mw_begin_stream`).
+
+ * Example usage
+
+ ```c
+ midi_io_t io;
+
+ mio_file (&io, fopen ("single.mid", "wb"));
+ mc_flatten (&io, tracks, tracklens, ntracks, mr.tickdiv);
+ ```
+ */
+
+#ifndef MIDI_CONVERT_H
+#define MIDI_CONVERT_H
+
+#include "midi-io.h"
+#include "midi-parser.h"
+#include "midi-player.h"
+#include "midi-writer.h"
+
+#include <stdint.h>
+
+/* Merges event data of `ntracks` tracks, played together (as in a MIDI_FMT_MTRACK file), and writes it to `io` as a
+ * MIDI_FMT_SINGLE file; Tracks of a MIDI_FMT_MSONG file are separate songs, and must not be passed here;
+ * On success returns 0;
+ * On failure (malformed event, write error, NULL argument, out of memory) returns -1. */
+int mc_flatten (const midi_io_t *io, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks,
+                uint16_t tickdiv);
+
+/* Splits event data of a single track by channel, and writes it to `io` as a MIDI_FMT_MTRACK file: first the
+ * conductor track, with all meta and sysex events, then one track per channel used, in channel order;
+ * On success returns number of tracks written;
+ * On failure (malformed event, write error, NULL argument, out of memory) returns -1. */
+int mc_split (const midi_io_t *io, const uint8_t *track, uint32_t len, uint16_t tickdiv);
+
+#ifdef MIDI_CONVERT_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+#define _MC_BUF 1024 /* `mc_flatten` output buffer */
+
+/* Starts a file on `io`, through a stream writer if it can't seek */
+static int
+_mc_begin (midi_writer_t *mw, const midi_io_t *io, uint16_t format, uint16_t ntracks, uint16_t tickdiv)
+{
+    memset (mw, 0, sizeof *mw);
+    if (io->seek) return mw_begin_io (mw, io, format, tickdiv);
+    return mw_begin_stream (mw, io, format, ntracks, tickdiv);
+}
+
+/* Number of data bytes of a channel event */
+static uint32_t
+_mc_data_len (uint8_t status)
+{
+    return (status >> 4) == MIDI_PROGRAM || (status >> 4) == MIDI_CHAN_PRESSURE ? 1 : 2;
+}
+
+/* Encodes delta and status of an event into `out` (at most 6 bytes), and updates running status;
+ * returns number of bytes written */
+static uint32_t
+_mc_head (const track_event_t *e, uint32_t delta, uint8_t *running, uint8_t *out)
+{
+    uint32_t n = midi_vlq_encode (delta, out);
+    uint8_t status;
+
+    if (e->kind != EV_MIDI)
+    {
+        *running = 0; /* meta and sysex cancel running status */
+        return n;
+    }
+
+    status = e->as.midi.kind << 4 | e->as.midi.channel;
+    if (status != *running) out[n++] = status;
+    *running = status;
+
+    return n;
+}
+
+/* Finds the part of the source event copied to the output as is - data bytes of channel events, everything after the
+ * delta for meta and sysex; `raw` are the event bytes following the delta in the source; returns its length */
+static uint32_t
+_mc_body (const track_event_t *e, const uint8_t *raw, uint32_t raw_len, const uint8_t **out_body)
+{
+    uint32_t n = e->kind == EV_MIDI ? _mc_data_len (e->as.midi.kind << 4) : raw_len;
+
+    if (n > raw_len) n = raw_len;
+    *out_body = raw + raw_len - n;
+    return n;
+}
+
+int
+mc_flatten (const midi_io_t *io, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks,
+            uint16_t tickdiv)
+{
+    static const uint8_t eot[3] = { 0xFF, 0x2F, 0x00 };
+    midi_writer_t mw;
+    mp_merge_t merge = { 0 };
+    mp_event_t e;
+    uint8_t buf[_MC_BUF], running = 0;
+    const uint8_t *body;
+    uint32_t n = 0, prev = 0, end = 0, body_len;
+    int have, status = -1;
+
+    if (io == NULL || io->write == NULL) return -1;
+    if (mp_merge_begin (&merge, tracks, lens, ntracks) != 0) return -1;
+    if (_mc_begin (&mw, io, MIDI_FMT_SINGLE, 1, tickdiv) != 0)
+    {
+        mp_merge_end (&merge);
+        return -1;
+    }
+    if (mw_track_begin (&mw) != 0) goto end;
+
+    while ((have = mp_merge_next (&merge, &e)) != 0)
+    {
+        if (have < 0) goto end;
+
+        if (e.tick > end) end = e.tick;
+        if (e.ev.kind == EV_META && e.ev.as.meta.type == 0x2F) continue; /* one end of track, at the very end */
+
+        if (n + 6 > sizeof buf)
+        {
+            if (mw_track_append (&mw, buf, n) != 0) goto end;
+            n = 0;
+        }
+        n += _mc_head (&e.ev, e.tick - prev, &running, buf + n);
+        prev = e.tick;
+
+        body_len = _mc_body (&e.ev, e.raw, e.raw_len, &body);
+        if (n + body_len > sizeof buf)
+        {
+            /* long meta / sysex - straight from the source track */
+            if (mw_track_append (&mw, buf, n) != 0 || mw_track_append (&mw, body, body_len) != 0) goto end;
+            n = 0;
+        }
+        else
+        {
+            memcpy (buf + n, body, body_len);
+            n += body_len;
+        }
+    }
+
+    if (n + 8 > sizeof buf)
+    {
+        if (mw_track_append (&mw, buf, n) != 0) goto end;
+        n = 0;
+    }
+    n += midi_vlq_encode (end - prev, buf + n);
+    memcpy (buf + n, eot, sizeof eot);
+    n += sizeof eot;
+
+    if (mw_track_append (&mw, buf, n) != 0 || mw_track_end (&mw) != 0) goto end;
+    status = 0;
+
+end:
+    if (mw_end (&mw) != 0) status = -1;
+    mp_merge_end (&merge);
+    return status;
+}
+
+/* Output track of an event - 0 for the conductor track, 1 + channel for channel events */
+static int
+_mc_split_dest (const track_event_t *e)
+{
+    return e->kind == EV_MIDI ? 1 + e->as.midi.channel : 0;
+}
+
+/* Walks the source track once; with `out` NULL, adds size of each output track to `size`, otherwise writes each
+ * output track at `out` + `offset` (and moves `offset` past it), using `size` of the first pass;
+ * returns 0, or -1 on a malformed event */
+static int
+_mc_split_pass (const uint8_t *track, uint32_t len, uint32_t *size, uint32_t *offset, uint8_t *out)
+{
+    track_parser_t tp = { 0 };
+    track_event_t ev = { 0 };
+    uint32_t tick = 0, last[17] = { 0 }, head_len, body_len;
+    uint8_t running[17] = { 0 }, head[8];
+    const uint8_t *body;
+    int n, d;
+
+    tp.bytes = track;
+    tp.len = len;
+
+    while (tp.idx < tp.len)
+    {
+        if ((n = track_event_next (&tp, &ev)) <= 0 || tp.idx > tp.len) return -1;
+        if (ev.delta > 0xFFFFFFFFU - tick) return -1;
+        tick += ev.delta;
+
+        if (ev.kind == EV_META && ev.as.meta.type == 0x2F) continue;
+
+        d = _mc_split_dest (&ev);
+        head_len = _mc_head (&ev, tick - last[d], &running[d], head);
+        body_len = _mc_body (&ev, tp.bytes + tp.idx - n, n, &body);
+        last[d] = tick;
+
+        if (out)
+        {
+            memcpy (out + offset[d], head, head_len);
+            memcpy (out + offset[d] + head_len, body, body_len);
+            offset[d] += head_len + body_len;
+        }
+        else
+            size[d] += head_len + body_len;
+    }
+
+    /* end of track events - the conductor track always has one, channel tracks only if used */
+    for (d = 0; d < 17; ++d)
+    {
+        if (d > 0 && size[d] == 0) continue;
+
+        head_len = midi_vlq_encode (tick - last[d], head);
+        head[head_len++] = 0xFF;
+        head[head_len++] = 0x2F;
+        head[head_len++] = 0x00;
+
+        if (out)
+        {
+            memcpy (out + offset[d], head, head_len);
+            offset[d] += head_len;
+        }
+        else
+            size[d] += head_len;
+    }
+
+    return 0;
+}
+
+int
+mc_split (const midi_io_t *io, const uint8_t *track, uint32_t len, uint16_t tickdiv)
+{
+    midi_writer_t mw;
+    uint32_t size[17] = { 0 }, offset[17], start[17], total = 0;
+    uint8_t *out = NULL;
+    uint16_t ntracks = 0;
+    int d, status = -1;
+
+    if (io == NULL || io->write == NULL || track == NULL) return -1;
+
+    if (_mc_split_pass (track, len, size, NULL, NULL) != 0) return -1;
+    for (d = 0; d < 17; ++d)
+    {
+        if (size[d] > 0xFFFFFFFFU - total) return -1;
+        start[d] = offset[d] = total;
+        total += size[d];
+        ntracks += size[d] > 0;
+    }
+
+    if ((out = malloc (total)) == NULL) return -1;
+    if (_mc_split_pass (track, len, size, offset, out) != 0) goto end;
+
+    if (_mc_begin (&mw, io, MIDI_FMT_MTRACK, ntracks, tickdiv) != 0) goto end;
+    for (d = 0; d < 17; ++d)
+    {
+        if (size[d] == 0) continue;
+        if (mw_track_begin (&mw) != 0 || mw_track_append (&mw, out + start[d], size[d]) != 0 || mw_track_end (&mw) != 0)
+        {
+            mw_end (&mw);
+            goto end;
+        }
+    }
+    if (mw_end (&mw) == 0) status = ntracks;
+
+end:
+    free (out);
+    return status;
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
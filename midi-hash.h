@@ -0,0 +1,320 @@
+/* MIDI-hash - canonical content hashes of tracks and files, for deduplication
+ * This header hashes what a track sounds like, rather than how it happens to be encoded: every event is reduced to
+ * (absolute tick, status, data), running status is resolved, note on with velocity 0 and note off (of any release
+ * velocity) hash the same, and text meta events are ignored. Event hashes are summed, so events sharing a tick may
+ * come in any order. File hashes combine track hashes the same way, so track order doesn't matter either.
+ * Hashes are XXH64-based; `mh_xxh64` is the plain XXH64 of a byte buffer.
+ * Hashes are computed while the parser walks the track - nothing is stored per event.
+
+ * Example usage
+
+ ```c
+ mh_file_t fh;
+ uint64_t th;
+
+ mh_file_begin (&fh);
+ while ((tracklen = mr_next_track (&mr)) > 0)
+ {
+     mr_get_track_data (&mr, evdata);
+     if (mh_track (evdata, tracklen, 0, &th) == 0) mh_file_add (&fh, th);
+ }
+ printf ("%016llx\n", (unsigned long long)mh_file_end (&fh));
+ ```
+ */
+
+#ifndef MIDI_HASH_H
+#define MIDI_HASH_H
+
+#include "midi-parser.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MH_SYSEX 0x1 /* also hash sysex events (ignored by default) */
+#define MH_META 0x2  /* also hash non-text meta events other than tempo, SMPTE offset, time and key signature */
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    uint64_t sum;   /* sum of event hashes */
+    uint32_t tick;  /* absolute tick of last event */
+    uint32_t count; /* number of hashed events */
+    uint32_t flags; /* MH_* */
+} mh_track_t;
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    uint64_t sum;     /* sum of track hashes */
+    uint32_t ntracks; /* number of non-empty tracks */
+} mh_file_t;
+
+/* Returns XXH64 hash of `len` bytes of `data`. */
+uint64_t mh_xxh64 (const void *data, size_t len, uint64_t seed);
+
+/* Starts hashing a track; `flags` is a combination of MH_* (or 0). */
+void mh_track_begin (mh_track_t *h, uint32_t flags);
+
+/* Adds event `e` (as returned by `track_event_next`) to the track hash; Call for every event of the track, in order. */
+void mh_track_event (mh_track_t *h, const track_event_t *e);
+
+/* Returns the hash of the track; 0 if no event of the track was hashed (e.g. it only holds text). */
+uint64_t mh_track_end (const mh_track_t *h);
+
+/* Parses and hashes a whole track;
+ * On success stores the hash in `out_hash` and returns 0;
+ * On failure (malformed event, NULL argument) returns -1. */
+int mh_track (const uint8_t *bytes, uint32_t len, uint32_t flags, uint64_t *out_hash);
+
+/* Starts hashing a file. */
+void mh_file_begin (mh_file_t *h);
+
+/* Adds a track hash to the file hash; Tracks with hash 0 (nothing hashed) are skipped. */
+void mh_file_add (mh_file_t *h, uint64_t track_hash);
+
+/* Returns the hash of the file; It doesn't depend on the order tracks were added in. */
+uint64_t mh_file_end (const mh_file_t *h);
+
+#ifdef MIDI_HASH_IMPLEMENTATION
+
+#define _MH_U64(hi, lo) (((uint64_t)(hi) << 32) | (uint64_t)(lo))
+#define _MH_P1 _MH_U64 (0x9E3779B1U, 0x85EBCA87U)
+#define _MH_P2 _MH_U64 (0xC2B2AE3DU, 0x27D4EB4FU)
+#define _MH_P3 _MH_U64 (0x165667B1U, 0x9E3779F9U)
+#define _MH_P4 _MH_U64 (0x85EBCA77U, 0xC2B2AE63U)
+#define _MH_P5 _MH_U64 (0x27D4EB2FU, 0x165667C5U)
+#define _MH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static uint64_t
+_mh_read64 (const uint8_t *p)
+{
+    return _MH_U64 ((uint32_t)p[7] << 24 | (uint32_t)p[6] << 16 | (uint32_t)p[5] << 8 | p[4],
+                    (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0]);
+}
+
+static uint32_t
+_mh_read32 (const uint8_t *p)
+{
+    return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+static uint64_t
+_mh_round (uint64_t acc, uint64_t input)
+{
+    acc += input * _MH_P2;
+    acc = _MH_ROTL (acc, 31);
+    return acc * _MH_P1;
+}
+
+static uint64_t
+_mh_merge (uint64_t acc, uint64_t val)
+{
+    acc ^= _mh_round (0, val);
+    return acc * _MH_P1 + _MH_P4;
+}
+
+static uint64_t
+_mh_avalanche (uint64_t h)
+{
+    h ^= h >> 33;
+    h *= _MH_P2;
+    h ^= h >> 29;
+    h *= _MH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t
+mh_xxh64 (const void *data, size_t len, uint64_t seed)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = p + len;
+    uint64_t h, v1, v2, v3, v4;
+
+    if (len >= 32)
+    {
+        v1 = seed + _MH_P1 + _MH_P2;
+        v2 = seed + _MH_P2;
+        v3 = seed;
+        v4 = seed - _MH_P1;
+
+        /* four independent lanes per 32-byte stripe */
+        do
+        {
+            v1 = _mh_round (v1, _mh_read64 (p));
+            v2 = _mh_round (v2, _mh_read64 (p + 8));
+            v3 = _mh_round (v3, _mh_read64 (p + 16));
+            v4 = _mh_round (v4, _mh_read64 (p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        h = _MH_ROTL (v1, 1) + _MH_ROTL (v2, 7) + _MH_ROTL (v3, 12) + _MH_ROTL (v4, 18);
+        h = _mh_merge (h, v1);
+        h = _mh_merge (h, v2);
+        h = _mh_merge (h, v3);
+        h = _mh_merge (h, v4);
+    }
+    else
+        h = seed + _MH_P5;
+
+    h += (uint64_t)len;
+
+    for (; end - p >= 8; p += 8)
+    {
+        h ^= _mh_round (0, _mh_read64 (p));
+        h = _MH_ROTL (h, 27) * _MH_P1 + _MH_P4;
+    }
+    if (end - p >= 4)
+    {
+        h ^= (uint64_t)_mh_read32 (p) * _MH_P1;
+        h = _MH_ROTL (h, 23) * _MH_P2 + _MH_P3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+    {
+        h ^= *p * _MH_P5;
+        h = _MH_ROTL (h, 11) * _MH_P1;
+    }
+
+    return _mh_avalanche (h);
+}
+
+/* Hash of a single canonical event: `lane` holds tick, status and up to two data bytes; `extra` anything else */
+static uint64_t
+_mh_event (uint64_t lane, uint64_t extra)
+{
+    uint64_t h = _MH_P5 + 16;
+
+    h ^= _mh_round (0, lane);
+    h = _MH_ROTL (h, 27) * _MH_P1 + _MH_P4;
+    h ^= _mh_round (0, extra);
+    h = _MH_ROTL (h, 27) * _MH_P1 + _MH_P4;
+
+    return _mh_avalanche (h);
+}
+
+void
+mh_track_begin (mh_track_t *h, uint32_t flags)
+{
+    if (h == NULL) return;
+
+    h->sum = 0;
+    h->tick = 0;
+    h->count = 0;
+    h->flags = flags;
+}
+
+void
+mh_track_event (mh_track_t *h, const track_event_t *e)
+{
+    uint64_t lane, extra = 0;
+    uint8_t status, d1 = 0, d2 = 0, type;
+
+    if (h == NULL || e == NULL) return;
+
+    h->tick += e->delta;
+    lane = (uint64_t)h->tick << 24;
+
+    switch (e->kind)
+    {
+    case EV_MIDI:
+        status = e->as.midi.kind << 4 | e->as.midi.channel;
+        switch (e->as.midi.kind)
+        {
+        case MIDI_PITCH_BEND:
+            d1 = e->as.midi.as.pitch_bend & 0x7F;
+            d2 = (e->as.midi.as.pitch_bend >> 7) & 0x7F;
+            break;
+        case MIDI_PROGRAM:
+        case MIDI_CHAN_PRESSURE: d1 = e->as.midi.as.bytes[0]; break;
+        case MIDI_NOTE_ON:
+            d1 = e->as.midi.as.note_on.note;
+            d2 = e->as.midi.as.note_on.velocity;
+            if (d2 == 0) status = MIDI_NOTE_OFF << 4 | e->as.midi.channel;
+            break;
+        case MIDI_NOTE_OFF: d1 = e->as.midi.as.note_off.note; break; /* release velocity is ignored */
+        default:
+            d1 = e->as.midi.as.bytes[0];
+            d2 = e->as.midi.as.bytes[1];
+            break;
+        }
+        lane |= (uint64_t)status << 16 | (uint64_t)d1 << 8 | d2;
+        break;
+    case EV_META:
+        type = e->as.meta.type;
+        if (type >= 0x01 && type <= 0x0F) return; /* text */
+        if (type == 0x2F) return;                 /* end of track position is an encoding detail */
+        if (type != 0x51 && type != 0x54 && type != 0x58 && type != 0x59 && !(h->flags & MH_META)) return;
+        lane |= (uint64_t)0xFF << 16 | (uint64_t)type << 8;
+        extra = mh_xxh64 (e->as.meta.data, e->as.meta.length, 0);
+        break;
+    case EV_SYSEX:
+        if (!(h->flags & MH_SYSEX)) return;
+        lane |= (uint64_t)0xF0 << 16;
+        extra = mh_xxh64 (e->as.sysex.data, e->as.sysex.length, 0);
+        break;
+    default: return;
+    }
+
+    h->sum += _mh_event (lane, extra);
+    h->count += 1;
+}
+
+uint64_t
+mh_track_end (const mh_track_t *h)
+{
+    if (h == NULL || h->count == 0) return 0;
+    return _mh_avalanche (h->sum ^ ((uint64_t)h->count * _MH_P1));
+}
+
+int
+mh_track (const uint8_t *bytes, uint32_t len, uint32_t flags, uint64_t *out_hash)
+{
+    track_parser_t tp = { 0 };
+    track_event_t ev = { 0 };
+    mh_track_t h;
+
+    if (bytes == NULL || out_hash == NULL) return -1;
+
+    tp.bytes = bytes;
+    tp.len = len;
+    mh_track_begin (&h, flags);
+
+    while (tp.idx < tp.len)
+    {
+        if (track_event_next (&tp, &ev) <= 0) return -1;
+        mh_track_event (&h, &ev);
+    }
+
+    *out_hash = mh_track_end (&h);
+    return 0;
+}
+
+void
+mh_file_begin (mh_file_t *h)
+{
+    if (h == NULL) return;
+
+    h->sum = 0;
+    h->ntracks = 0;
+}
+
+void
+mh_file_add (mh_file_t *h, uint64_t track_hash)
+{
+    if (h == NULL || track_hash == 0) return;
+
+    h->sum += _mh_avalanche (track_hash + _MH_P3);
+    h->ntracks += 1;
+}
+
+uint64_t
+mh_file_end (const mh_file_t *h)
+{
+    if (h == NULL) return 0;
+    return _mh_avalanche (h->sum ^ ((uint64_t)h->ntracks * _MH_P2));
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
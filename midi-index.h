@@ -0,0 +1,678 @@
+/* MIDI-index - sharded inverted index over a MIDI corpus
+ * This header answers queries like "files with pitch sequence X" or "songs using program 0x19 on channel 10" without
+ * parsing the corpus again. A builder runs `track_event_next` over every track once and collects (key, document)
+ * pairs; keys are program changes per channel, pitch trigrams (consecutive note on pitches of one channel) and meta
+ * event types. Each batch of documents is written out as one shard: a sorted key table followed by posting lists of
+ * document ids, delta coded as MIDI variable length quantities (`midi_vlq_encode`).
+ * Shards are used straight from `mmap`, and a query (an AND of keys) runs on all shards of an index at once, from a
+ * pool of threads.
+ * Pitch sequence queries are an AND of trigrams, so they return candidates: every trigram of the sequence occurs in
+ * the document, but not necessarily one right after another.
+ * The implementation uses POSIX APIs (mmap, pthreads) - compile it with `_GNU_SOURCE` defined before any system header,
+ * and link with `-pthread`.
+
+ * Example usage
+
+ ```c
+ mi_builder_t b = { 0 };
+ midi_index_t idx = { 0 };
+ uint32_t key = MI_KEY_PROGRAM (9, 0x19), docs[64];
+ int32_t n;
+
+ for (doc = 0; doc < nfiles; ++doc)
+     for (t = 0; t < ntracks[doc]; ++t) mi_add_track (&b, doc, tracks[doc][t], tracklens[doc][t]);
+ mi_builder_write (&b, &io); // `io` writes to "corpus.midx"
+ mi_builder_free (&b);
+
+ mi_index_add (&idx, "corpus.midx");
+ n = mi_search (&idx, &key, 1, 4, docs, 64); // docs[0 .. n-1] use program 0x19 on channel 10
+ mi_index_end (&idx);
+ ```
+ */
+
+#ifndef MIDI_INDEX_H
+#define MIDI_INDEX_H
+
+#include "midi-io.h"
+#include "midi-parser.h"
+
+#include <stdint.h>
+
+#define MI_NGRAM 3 /* length of indexed pitch sequences */
+
+#define MI_MAX_DOC 0x0FFFFFFFU /* largest document id (largest MIDI variable length quantity) */
+
+/* Program `program` (0..127) set on `channel` (0..15) */
+#define MI_KEY_PROGRAM(channel, program)                                                                              \
+    (0x10000000U | ((uint32_t)(channel) & 0x0F) << 8 | ((uint32_t)(program) & 0x7F))
+/* Meta event of type `type` present */
+#define MI_KEY_META(type) (0x20000000U | ((uint32_t)(type) & 0xFF))
+/* Note on pitches `p0`, `p1`, `p2` played one after another on a single channel */
+#define MI_KEY_NGRAM(p0, p1, p2)                                                                                      \
+    (0x30000000U | ((uint32_t)(p0) & 0x7F) << 14 | ((uint32_t)(p1) & 0x7F) << 7 | ((uint32_t)(p2) & 0x7F))
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    uint64_t *pairs; /* key << 32 | document */
+    uint32_t npairs, cap;
+    uint32_t seg;       /* index of the first pair of the current document */
+    uint32_t doc;       /* current document */
+    uint32_t ndocs;     /* number of documents since the last shard */
+    uint32_t doc_first; /* first document since the last shard */
+} mi_builder_t;
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    const uint8_t *data; /* whole shard */
+    uint32_t len;
+    uint32_t doc_first, doc_last; /* range of document ids in the shard */
+    uint32_t nkeys;
+    const uint8_t *keys;     /* key table, `nkeys` entries of 12 bytes */
+    const uint8_t *postings; /* posting lists */
+    uint32_t postings_len;
+    int mapped; /* 1 - `data` is mapped by `mi_shard_open`; 0 - owned by the caller */
+} mi_shard_t;
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    mi_shard_t *shards;
+    uint32_t nshards, cap;
+} midi_index_t;
+
+/* Adds keys found in the event data of a single track to document `doc`;
+ * Call it for every track of a document; Documents must come in non-decreasing order, and `doc` <= MI_MAX_DOC;
+ * On success returns 0;
+ * On failure (malformed event, out of order document, NULL argument, out of memory) returns -1. No key of the track is
+ * added then, and a new `doc` is not counted. */
+int mi_add_track (mi_builder_t *b, uint32_t doc, const uint8_t *bytes, uint32_t len);
+
+/* Writes documents added since the last call as one shard to `io` (only `write` is used), and empties the builder;
+ * On success returns 0;
+ * On failure (write error, NULL argument, out of memory) returns -1. The builder keeps its documents then. */
+int mi_builder_write (mi_builder_t *b, const midi_io_t *io);
+
+/* Releases memory held by the builder. */
+void mi_builder_free (mi_builder_t *b);
+
+/* Maps shard file `path` into memory, and checks its header;
+ * On success returns 0;
+ * On failure (I/O error, not a shard, NULL argument) returns -1. */
+int mi_shard_open (mi_shard_t *s, const char *path);
+
+/* Uses `len` bytes of `data` (e.g. written with `mio_mem`) as a shard; `data` must outlive `s`;
+ * On success returns 0;
+ * On failure (not a shard, NULL argument) returns -1. */
+int mi_shard_from_memory (mi_shard_t *s, const uint8_t *data, uint32_t len);
+
+/* Unmaps the shard, if it was opened with `mi_shard_open`. */
+void mi_shard_close (mi_shard_t *s);
+
+/* Finds documents of a shard holding all `nkeys` keys, in increasing order;
+ * On success stores up to `cap` of them in `out_docs` and returns the number of matching documents (which may be
+ * larger than `cap`);
+ * On failure (corrupt shard, NULL argument, `nkeys` is 0, out of memory) returns -1. */
+int32_t mi_shard_search (const mi_shard_t *s, const uint32_t *keys, uint32_t nkeys, uint32_t *out_docs, uint32_t cap);
+
+/* Opens shard file `path` (see `mi_shard_open`), and adds it to the index;
+ * On success returns 0;
+ * On failure (see `mi_shard_open`, out of memory) returns -1. */
+int mi_index_add (midi_index_t *idx, const char *path);
+
+/* Closes all shards of the index. */
+void mi_index_end (midi_index_t *idx);
+
+/* Searches all shards of the index (see `mi_shard_search`), using up to `nthreads` threads (including the calling
+ * one); Documents are reported shard by shard, in the order shards were added;
+ * On success stores up to `cap` documents in `out_docs` and returns the number of matching documents;
+ * On failure (corrupt shard, NULL argument, `nkeys` is 0, out of memory) returns -1. */
+int32_t mi_search (const midi_index_t *idx, const uint32_t *keys, uint32_t nkeys, unsigned nthreads, uint32_t *out_docs,
+                   uint32_t cap);
+
+/* Stores the MI_KEY_NGRAM keys of a pitch sequence in `out_keys` (which needs room for `n` - 2 of them);
+ * On success returns number of keys stored;
+ * On failure (`n` < MI_NGRAM, NULL argument) returns -1. */
+int mi_pitch_keys (const uint8_t *pitches, uint32_t n, uint32_t *out_keys);
+
+#ifdef MIDI_INDEX_IMPLEMENTATION
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Shard layout (all integers little endian):
+ * header - "MIDX", version, doc_first, doc_last, nkeys, postings_len (6 x 4 bytes)
+ * key table - `nkeys` x { key, count, offset }, sorted by key; `offset` is relative to the posting lists
+ * posting lists - for each key, `count` VLQs: first document - doc_first, then differences to the previous document */
+#define _MI_MAGIC 0x5844494DU /* "MIDX" */
+#define _MI_VERSION 1
+#define _MI_HEADER_LEN 24
+#define _MI_KEY_LEN 12
+
+static uint32_t
+_mi_get_u32 (const uint8_t *b)
+{
+    return (uint32_t)b[3] << 24 | (uint32_t)b[2] << 16 | (uint32_t)b[1] << 8 | b[0];
+}
+
+static void
+_mi_put_u32 (uint8_t *b, uint32_t v)
+{
+    b[0] = v;
+    b[1] = v >> 8;
+    b[2] = v >> 16;
+    b[3] = v >> 24;
+}
+
+static int
+_mi_cmp_u64 (const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Sorts pairs from `from` on, and drops duplicates; returns new number of pairs */
+static uint32_t
+_mi_unique (uint64_t *pairs, uint32_t from, uint32_t n)
+{
+    uint32_t i, out;
+
+    if (n - from < 2) return n;
+    qsort (pairs + from, n - from, sizeof *pairs, _mi_cmp_u64);
+
+    for (i = out = from + 1; i < n; ++i)
+        if (pairs[i] != pairs[out - 1]) pairs[out++] = pairs[i];
+
+    return out;
+}
+
+static int
+_mi_push (mi_builder_t *b, uint32_t key)
+{
+    uint64_t *p;
+    uint32_t cap;
+
+    if (b->npairs == b->cap)
+    {
+        cap = b->cap ? b->cap * 2 : 4096;
+        if (cap < b->cap || (p = realloc (b->pairs, (size_t)cap * sizeof *p)) == NULL) return -1;
+        b->pairs = p;
+        b->cap = cap;
+    }
+
+    b->pairs[b->npairs++] = (uint64_t)key << 32 | b->doc;
+    return 0;
+}
+
+int
+mi_add_track (mi_builder_t *b, uint32_t doc, const uint8_t *bytes, uint32_t len)
+{
+    track_parser_t tp = { 0 };
+    track_event_t ev = { 0 };
+    uint8_t hist[16][2];
+    uint8_t nhist[16] = { 0 };
+    uint32_t saved, saved_seg, saved_doc, saved_ndocs, saved_first, key;
+    uint8_t ch, pitch;
+
+    if (b == NULL || bytes == NULL || doc > MI_MAX_DOC) return -1;
+    if (b->ndocs > 0 && doc < b->doc) return -1;
+
+    saved_seg = b->seg;
+    saved_doc = b->doc;
+    saved_ndocs = b->ndocs;
+    saved_first = b->doc_first;
+
+    if (b->ndocs == 0 || doc != b->doc)
+    {
+        /* previous document is complete - drop its duplicate keys */
+        b->npairs = _mi_unique (b->pairs, b->seg, b->npairs);
+        b->seg = b->npairs;
+        if (b->ndocs == 0) b->doc_first = doc;
+        b->doc = doc;
+        b->ndocs += 1;
+    }
+
+    saved = b->npairs;
+    tp.bytes = bytes;
+    tp.len = len;
+
+    while (tp.idx < tp.len)
+    {
+        if (track_event_next (&tp, &ev) <= 0) goto fail;
+
+        key = 0;
+        if (ev.kind == EV_META)
+            key = MI_KEY_META (ev.as.meta.type);
+        else if (ev.kind == EV_MIDI && ev.as.midi.kind == MIDI_PROGRAM)
+            key = MI_KEY_PROGRAM (ev.as.midi.channel, ev.as.midi.as.program);
+        else if (ev.kind == EV_MIDI && ev.as.midi.kind == MIDI_NOTE_ON && ev.as.midi.as.note_on.velocity > 0)
+        {
+            ch = ev.as.midi.channel;
+            pitch = ev.as.midi.as.note_on.note;
+            if (nhist[ch] == 2) key = MI_KEY_NGRAM (hist[ch][0], hist[ch][1], pitch);
+
+            if (nhist[ch] < 2) nhist[ch] += 1;
+            hist[ch][0] = hist[ch][1];
+            hist[ch][1] = pitch;
+        }
+
+        if (key != 0 && _mi_push (b, key) != 0) goto fail;
+    }
+
+    return 0;
+
+fail:
+    /* leave the builder as it was, document count included; pairs before `saved` are only deduplicated */
+    b->npairs = saved;
+    b->seg = saved_seg;
+    b->doc = saved_doc;
+    b->ndocs = saved_ndocs;
+    b->doc_first = saved_first;
+    return -1;
+}
+
+static int
+_mi_write (const midi_io_t *io, const uint8_t *buf, uint32_t len)
+{
+    int32_t n;
+
+    while (len > 0)
+    {
+        if ((n = io->write (io->ctx, buf, len)) <= 0) return -1;
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+int
+mi_builder_write (mi_builder_t *b, const midi_io_t *io)
+{
+    uint8_t header[_MI_HEADER_LEN], *table = NULL, *postings = NULL;
+    uint32_t i, k, nkeys = 0, postings_len = 0, prev = 0, count = 0, key, doc;
+    int status = -1;
+
+    if (b == NULL || io == NULL || io->write == NULL) return -1;
+
+    b->npairs = _mi_unique (b->pairs, b->seg, b->npairs);
+    b->seg = b->npairs;
+
+    /* pairs are sorted by document (documents come in order), and by key within each document - sort by key */
+    qsort (b->pairs, b->npairs, sizeof *b->pairs, _mi_cmp_u64);
+
+    for (i = 0; i < b->npairs; ++i)
+    {
+        key = b->pairs[i] >> 32;
+        doc = b->pairs[i] & 0xFFFFFFFFU;
+        if (i == 0 || key != (uint32_t)(b->pairs[i - 1] >> 32))
+        {
+            nkeys += 1;
+            prev = b->doc_first;
+        }
+        postings_len += midi_vlq_encode (doc - prev, NULL);
+        prev = doc;
+    }
+
+    if ((table = malloc (nkeys ? (size_t)nkeys * _MI_KEY_LEN : 1)) == NULL) goto end;
+    if ((postings = malloc (postings_len ? postings_len : 1)) == NULL) goto end;
+
+    for (i = 0, k = 0, postings_len = 0; i < b->npairs; ++i)
+    {
+        key = b->pairs[i] >> 32;
+        doc = b->pairs[i] & 0xFFFFFFFFU;
+        if (i == 0 || key != (uint32_t)(b->pairs[i - 1] >> 32))
+        {
+            _mi_put_u32 (table + k * _MI_KEY_LEN, key);
+            _mi_put_u32 (table + k * _MI_KEY_LEN + 8, postings_len);
+            k += 1;
+            prev = b->doc_first;
+            count = 0;
+        }
+        _mi_put_u32 (table + (k - 1) * _MI_KEY_LEN + 4, ++count);
+        postings_len += midi_vlq_encode (doc - prev, postings + postings_len);
+        prev = doc;
+    }
+
+    _mi_put_u32 (header, _MI_MAGIC);
+    _mi_put_u32 (header + 4, _MI_VERSION);
+    _mi_put_u32 (header + 8, b->ndocs ? b->doc_first : 0);
+    _mi_put_u32 (header + 12, b->ndocs ? b->doc : 0);
+    _mi_put_u32 (header + 16, nkeys);
+    _mi_put_u32 (header + 20, postings_len);
+
+    if (_mi_write (io, header, _MI_HEADER_LEN) != 0) goto end;
+    if (_mi_write (io, table, nkeys * _MI_KEY_LEN) != 0) goto end;
+    if (_mi_write (io, postings, postings_len) != 0) goto end;
+
+    b->npairs = b->seg = 0;
+    b->ndocs = 0;
+    status = 0;
+
+end:
+    free (table);
+    free (postings);
+    return status;
+}
+
+void
+mi_builder_free (mi_builder_t *b)
+{
+    if (b == NULL) return;
+
+    free (b->pairs);
+    memset (b, 0, sizeof *b);
+}
+
+int
+mi_shard_from_memory (mi_shard_t *s, const uint8_t *data, uint32_t len)
+{
+    uint32_t nkeys, postings_len;
+
+    if (s == NULL || data == NULL || len < _MI_HEADER_LEN) return -1;
+    if (_mi_get_u32 (data) != _MI_MAGIC || _mi_get_u32 (data + 4) != _MI_VERSION) return -1;
+
+    nkeys = _mi_get_u32 (data + 16);
+    postings_len = _mi_get_u32 (data + 20);
+    if (nkeys > (len - _MI_HEADER_LEN) / _MI_KEY_LEN) return -1;
+    if (postings_len != len - _MI_HEADER_LEN - nkeys * _MI_KEY_LEN) return -1;
+    if (_mi_get_u32 (data + 8) > _mi_get_u32 (data + 12) || _mi_get_u32 (data + 12) > MI_MAX_DOC) return -1;
+
+    s->data = data;
+    s->len = len;
+    s->doc_first = _mi_get_u32 (data + 8);
+    s->doc_last = _mi_get_u32 (data + 12);
+    s->nkeys = nkeys;
+    s->keys = data + _MI_HEADER_LEN;
+    s->postings = s->keys + nkeys * _MI_KEY_LEN;
+    s->postings_len = postings_len;
+    s->mapped = 0;
+
+    return 0;
+}
+
+int
+mi_shard_open (mi_shard_t *s, const char *path)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    if (s == NULL || path == NULL) return -1;
+
+    if ((fd = open (path, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+    if (fstat (fd, &st) != 0 || st.st_size < _MI_HEADER_LEN || st.st_size > (off_t)UINT32_MAX)
+    {
+        close (fd);
+        return -1;
+    }
+
+    data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (data == MAP_FAILED) return -1;
+
+    if (mi_shard_from_memory (s, data, st.st_size) != 0)
+    {
+        munmap (data, st.st_size);
+        return -1;
+    }
+
+    s->mapped = 1;
+    return 0;
+}
+
+void
+mi_shard_close (mi_shard_t *s)
+{
+    if (s == NULL) return;
+
+    if (s->mapped) munmap ((void *)s->data, s->len);
+    memset (s, 0, sizeof *s);
+}
+
+/* Finds `key` in the key table; returns its entry, or NULL */
+static const uint8_t *
+_mi_lookup (const mi_shard_t *s, uint32_t key)
+{
+    uint32_t lo = 0, hi = s->nkeys, mid, k;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        k = _mi_get_u32 (s->keys + mid * _MI_KEY_LEN);
+        if (k == key) return s->keys + mid * _MI_KEY_LEN;
+        if (k < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return NULL;
+}
+
+/* Decodes the next document of a posting list; returns 0, or -1 on a corrupt list */
+static int
+_mi_next_doc (const mi_shard_t *s, uint32_t *off, uint32_t *doc)
+{
+    uint32_t delta;
+    int n;
+
+    if ((n = midi_vlq_decode (s->postings + *off, s->postings_len - *off, &delta)) <= 0) return -1;
+    if (delta > MI_MAX_DOC - *doc) return -1;
+
+    *off += n;
+    *doc += delta;
+    return 0;
+}
+
+/* Intersects posting lists of all keys into a newly allocated `*out_docs`;
+ * returns number of documents, or -1 on failure */
+static int32_t
+_mi_match (const mi_shard_t *s, const uint32_t *keys, uint32_t nkeys, uint32_t **out_docs)
+{
+    const uint8_t *entry, *shortest = NULL;
+    uint32_t *docs, i, j, n, out, count, off, doc;
+
+    *out_docs = NULL;
+
+    /* start from the shortest list, and filter it with each of the others */
+    for (i = 0; i < nkeys; ++i)
+    {
+        if ((entry = _mi_lookup (s, keys[i])) == NULL) return 0;
+        if (_mi_get_u32 (entry + 8) > s->postings_len) return -1;
+        if (_mi_get_u32 (entry + 4) > s->postings_len - _mi_get_u32 (entry + 8)) return -1; /* >= 1 byte each */
+        if (shortest == NULL || _mi_get_u32 (entry + 4) < _mi_get_u32 (shortest + 4)) shortest = entry;
+    }
+
+    n = _mi_get_u32 (shortest + 4);
+    if ((docs = malloc (n ? (size_t)n * sizeof *docs : 1)) == NULL) return -1;
+
+    off = _mi_get_u32 (shortest + 8);
+    doc = s->doc_first;
+    for (j = 0; j < n; ++j)
+    {
+        if (_mi_next_doc (s, &off, &doc) != 0) goto fail;
+        docs[j] = doc;
+    }
+
+    for (i = 0; i < nkeys && n > 0; ++i)
+    {
+        entry = _mi_lookup (s, keys[i]);
+        if (entry == shortest) continue;
+
+        count = _mi_get_u32 (entry + 4);
+        off = _mi_get_u32 (entry + 8);
+        doc = s->doc_first;
+
+        for (j = 0, out = 0; j < n && count > 0; --count)
+        {
+            if (_mi_next_doc (s, &off, &doc) != 0) goto fail;
+            while (j < n && docs[j] < doc) ++j;
+            if (j < n && docs[j] == doc) docs[out++] = docs[j++];
+        }
+        n = out;
+    }
+
+    *out_docs = docs;
+    return n;
+
+fail:
+    free (docs);
+    return -1;
+}
+
+int32_t
+mi_shard_search (const mi_shard_t *s, const uint32_t *keys, uint32_t nkeys, uint32_t *out_docs, uint32_t cap)
+{
+    uint32_t *docs;
+    int32_t n;
+
+    if (s == NULL || keys == NULL || nkeys == 0 || (out_docs == NULL && cap > 0)) return -1;
+
+    if ((n = _mi_match (s, keys, nkeys, &docs)) < 0) return -1;
+    if (n > 0 && cap > 0) memcpy (out_docs, docs, ((uint32_t)n < cap ? (uint32_t)n : cap) * sizeof *docs);
+    free (docs);
+
+    return n;
+}
+
+int
+mi_index_add (midi_index_t *idx, const char *path)
+{
+    mi_shard_t *p;
+    uint32_t cap;
+
+    if (idx == NULL) return -1;
+
+    if (idx->nshards == idx->cap)
+    {
+        cap = idx->cap ? idx->cap * 2 : 16;
+        if ((p = realloc (idx->shards, cap * sizeof *p)) == NULL) return -1;
+        idx->shards = p;
+        idx->cap = cap;
+    }
+
+    memset (&idx->shards[idx->nshards], 0, sizeof *idx->shards);
+    if (mi_shard_open (&idx->shards[idx->nshards], path) != 0) return -1;
+    idx->nshards += 1;
+
+    return 0;
+}
+
+void
+mi_index_end (midi_index_t *idx)
+{
+    uint32_t i;
+
+    if (idx == NULL) return;
+
+    for (i = 0; i < idx->nshards; ++i) mi_shard_close (&idx->shards[i]);
+    free (idx->shards);
+    memset (idx, 0, sizeof *idx);
+}
+
+/* Shared state of the threads running a query; each thread takes the next shard until none is left */
+typedef struct
+{
+    const midi_index_t *idx;
+    const uint32_t *keys;
+    uint32_t nkeys;
+    pthread_mutex_t lock;
+    uint32_t next;
+    uint32_t **docs;
+    int32_t *counts;
+} _mi_job_t;
+
+static void *
+_mi_worker (void *arg)
+{
+    _mi_job_t *job = arg;
+    uint32_t i;
+
+    for (;;)
+    {
+        pthread_mutex_lock (&job->lock);
+        i = job->next++;
+        pthread_mutex_unlock (&job->lock);
+
+        if (i >= job->idx->nshards) break;
+        job->counts[i] = _mi_match (&job->idx->shards[i], job->keys, job->nkeys, &job->docs[i]);
+    }
+
+    return NULL;
+}
+
+int32_t
+mi_search (const midi_index_t *idx, const uint32_t *keys, uint32_t nkeys, unsigned nthreads, uint32_t *out_docs,
+           uint32_t cap)
+{
+    _mi_job_t job;
+    pthread_t *threads = NULL;
+    unsigned started = 0, t;
+    uint32_t i, stored = 0, total = 0, n;
+    int32_t status = -1;
+
+    if (idx == NULL || keys == NULL || nkeys == 0 || (out_docs == NULL && cap > 0)) return -1;
+    if (idx->nshards == 0) return 0;
+
+    job.idx = idx;
+    job.keys = keys;
+    job.nkeys = nkeys;
+    job.next = 0;
+    job.docs = calloc (idx->nshards, sizeof *job.docs);
+    job.counts = calloc (idx->nshards, sizeof *job.counts);
+    if (job.docs == NULL || job.counts == NULL || pthread_mutex_init (&job.lock, NULL) != 0) goto end;
+
+    if (nthreads > idx->nshards) nthreads = idx->nshards;
+    if (nthreads > 1 && (threads = malloc ((nthreads - 1) * sizeof *threads)) != NULL)
+        for (t = 0; t + 1 < nthreads; ++t)
+        {
+            if (pthread_create (&threads[t], NULL, _mi_worker, &job) != 0) break; /* fewer threads then */
+            started += 1;
+        }
+
+    _mi_worker (&job);
+    for (t = 0; t < started; ++t) pthread_join (threads[t], NULL);
+    pthread_mutex_destroy (&job.lock);
+
+    for (i = 0; i < idx->nshards; ++i)
+    {
+        if (job.counts[i] < 0 || (uint32_t)job.counts[i] > 0x7FFFFFFFU - total) goto end;
+
+        n = job.counts[i];
+        if (n > cap - stored) n = cap - stored;
+        if (n > 0 && cap > 0) memcpy (out_docs + stored, job.docs[i], n * sizeof *out_docs);
+        stored += n;
+        total += job.counts[i];
+    }
+    status = total;
+
+end:
+    if (job.docs)
+        for (i = 0; i < idx->nshards; ++i) free (job.docs[i]);
+    free (job.docs);
+    free (job.counts);
+    free (threads);
+    return status;
+}
+
+int
+mi_pitch_keys (const uint8_t *pitches, uint32_t n, uint32_t *out_keys)
+{
+    uint32_t i;
+
+    if (pitches == NULL || out_keys == NULL || n < MI_NGRAM) return -1;
+
+    for (i = 0; i + MI_NGRAM <= n; ++i) out_keys[i] = MI_KEY_NGRAM (pitches[i], pitches[i + 1], pitches[i + 2]);
+    return n - MI_NGRAM + 1;
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
@@ -0,0 +1,256 @@
+/* MIDI-io - I/O callbacks used by midi-reader and midi-writer
+ * `midi_reader_t` and `midi_writer_t` don't talk to stdio directly - every read, write and seek goes through a
+ * `midi_io_t`. `mr_begin` and `mw_begin` wrap a `FILE *` into one; `mr_begin_io` and `mw_begin_io` accept any other
+ * source or destination (memory, sockets, async I/O completions, ...).
+ * With `MIDI_IO_IMPLEMENTATION` defined, this header also provides ready-made callbacks for `FILE *`, file descriptors
+ * (on POSIX systems) and memory buffers.
+
+ * Example usage
+
+ ```c
+ #define MIDI_IO_IMPLEMENTATION
+ #include "midi-io.h"
+
+ midi_io_t io;
+ mio_mem_t mem = { 0 };
+
+ mem.data = filedata;
+ mem.len = mem.cap = filelen;
+ mio_mem (&io, &mem);
+
+ mr_begin_io (&mr, &io);
+ ```
+ */
+
+#ifndef MIDI_IO_H
+#define MIDI_IO_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct
+{
+    /* Reads up to `len` bytes (at most 0x7FFFFFFF) into `buf`; returns number of bytes read, 0 at end of data, -1 on
+     * failure */
+    int32_t (*read) (void *ctx, uint8_t *buf, uint32_t len);
+    /* Writes up to `len` bytes (at most 0x7FFFFFFF) from `buf`; returns number of bytes written, -1 on failure */
+    int32_t (*write) (void *ctx, const uint8_t *buf, uint32_t len);
+    /* Optional; moves to absolute byte `offset`; returns 0 on success, -1 on failure */
+    int (*seek) (void *ctx, uint32_t offset);
+    /* Optional; stores total size of the data in `out_size`; returns 0 on success, -1 on failure (or if the size is
+     * over 0xFFFFFFFF) */
+    int (*size) (void *ctx, uint32_t *out_size);
+    void *ctx; /* passed to every callback */
+} midi_io_t;
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    uint8_t *data; /* buffer */
+    uint32_t len;  /* number of valid bytes in `data` (readable, and counted by `size`) */
+    uint32_t cap;  /* size of `data`; writes past it fail, unless `grow` is set */
+    uint32_t off;  /* current offset */
+    int grow;      /* 1 - writes past `cap` reallocate `data` (with `realloc`); 0 otherwise */
+} mio_mem_t;
+
+/* Fills `io` with callbacks reading / writing `f`;
+ * `seek` and `size` are only set if `f` is seekable (so pipes, such as `stdin` of a pipeline, have neither). */
+void mio_file (midi_io_t *io, FILE *f);
+
+/* Fills `io` with callbacks reading / writing file descriptor `fd`;
+ * `seek` and `size` are only set if `fd` is seekable (so pipes and sockets have neither). */
+void mio_fd (midi_io_t *io, int fd);
+
+/* Fills `io` with callbacks reading / writing memory buffer `m`; All four callbacks are set;
+ * `m` must outlive `io`. */
+void mio_mem (midi_io_t *io, mio_mem_t *m);
+
+#ifdef MIDI_IO_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MIDI_IO_HAVE_FD
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#define _MIO_MAX_XFER 0x7FFFFFFFU /* longest transfer whose byte count fits the int32_t result */
+
+static int32_t
+_mio_file_read (void *ctx, uint8_t *buf, uint32_t len)
+{
+    size_t n = fread (buf, 1, len < _MIO_MAX_XFER ? len : _MIO_MAX_XFER, ctx);
+    if (n == 0 && ferror ((FILE *)ctx)) return -1;
+    return n;
+}
+
+static int32_t
+_mio_file_write (void *ctx, const uint8_t *buf, uint32_t len)
+{
+    size_t n = fwrite (buf, 1, len < _MIO_MAX_XFER ? len : _MIO_MAX_XFER, ctx);
+    if (n == 0 && ferror ((FILE *)ctx)) return -1;
+    return n;
+}
+
+static int
+_mio_file_seek (void *ctx, uint32_t offset)
+{
+    return fseek (ctx, offset, SEEK_SET);
+}
+
+static int
+_mio_file_size (void *ctx, uint32_t *out_size)
+{
+    long saved, end;
+
+    if ((saved = ftell (ctx)) < 0) return -1;
+    if (fseek (ctx, 0, SEEK_END) != 0) return -1;
+    end = ftell (ctx);
+    if (fseek (ctx, saved, SEEK_SET) != 0 || end < 0 || (unsigned long)end > 0xFFFFFFFFUL) return -1;
+
+    *out_size = end;
+    return 0;
+}
+
+void
+mio_file (midi_io_t *io, FILE *f)
+{
+    int seekable;
+
+    if (io == NULL) return;
+
+    seekable = f != NULL && ftell (f) >= 0;
+
+    io->read = _mio_file_read;
+    io->write = _mio_file_write;
+    io->seek = seekable ? _mio_file_seek : NULL;
+    io->size = seekable ? _mio_file_size : NULL;
+    io->ctx = f;
+}
+
+#ifdef MIDI_IO_HAVE_FD
+
+/* the descriptor itself is stored in `ctx` */
+#define _MIO_FD(ctx) ((int)(intptr_t)(ctx))
+
+static int32_t
+_mio_fd_read (void *ctx, uint8_t *buf, uint32_t len)
+{
+    ssize_t n = read (_MIO_FD (ctx), buf, len < _MIO_MAX_XFER ? len : _MIO_MAX_XFER);
+    return n < 0 ? -1 : n;
+}
+
+static int32_t
+_mio_fd_write (void *ctx, const uint8_t *buf, uint32_t len)
+{
+    ssize_t n = write (_MIO_FD (ctx), buf, len < _MIO_MAX_XFER ? len : _MIO_MAX_XFER);
+    return n < 0 ? -1 : n;
+}
+
+static int
+_mio_fd_seek (void *ctx, uint32_t offset)
+{
+    return lseek (_MIO_FD (ctx), offset, SEEK_SET) < 0 ? -1 : 0;
+}
+
+static int
+_mio_fd_size (void *ctx, uint32_t *out_size)
+{
+    struct stat st;
+
+    if (fstat (_MIO_FD (ctx), &st) != 0 || st.st_size < 0 || (uint64_t)st.st_size > 0xFFFFFFFFU) return -1;
+    *out_size = st.st_size;
+    return 0;
+}
+
+void
+mio_fd (midi_io_t *io, int fd)
+{
+    int seekable;
+
+    if (io == NULL) return;
+
+    seekable = lseek (fd, 0, SEEK_CUR) >= 0;
+
+    io->read = _mio_fd_read;
+    io->write = _mio_fd_write;
+    io->seek = seekable ? _mio_fd_seek : NULL;
+    io->size = seekable ? _mio_fd_size : NULL;
+    io->ctx = (void *)(intptr_t)fd;
+}
+
+#endif /* MIDI_IO_HAVE_FD */
+
+static int32_t
+_mio_mem_read (void *ctx, uint8_t *buf, uint32_t len)
+{
+    mio_mem_t *m = ctx;
+
+    if (m->off >= m->len) return 0;
+    if (len > m->len - m->off) len = m->len - m->off;
+    if (len > _MIO_MAX_XFER) len = _MIO_MAX_XFER;
+
+    memcpy (buf, m->data + m->off, len);
+    m->off += len;
+    return len;
+}
+
+static int32_t
+_mio_mem_write (void *ctx, const uint8_t *buf, uint32_t len)
+{
+    mio_mem_t *m = ctx;
+    uint32_t cap;
+    void *p;
+
+    if (len > _MIO_MAX_XFER) len = _MIO_MAX_XFER;
+    if (len > m->cap - m->off || m->off > m->cap)
+    {
+        if (!m->grow || len > 0xFFFFFFFFU - m->off) return -1;
+
+        cap = m->cap ? m->cap : 4096;
+        while (cap < m->off + len) cap = cap > 0x7FFFFFFFU ? 0xFFFFFFFFU : cap * 2;
+        if ((p = realloc (m->data, cap)) == NULL) return -1;
+
+        m->data = p;
+        m->cap = cap;
+    }
+
+    if (m->off > m->len) memset (m->data + m->len, 0, m->off - m->len); /* seeked past the end */
+    memcpy (m->data + m->off, buf, len);
+    m->off += len;
+    if (m->off > m->len) m->len = m->off;
+    return len;
+}
+
+static int
+_mio_mem_seek (void *ctx, uint32_t offset)
+{
+    ((mio_mem_t *)ctx)->off = offset;
+    return 0;
+}
+
+static int
+_mio_mem_size (void *ctx, uint32_t *out_size)
+{
+    *out_size = ((mio_mem_t *)ctx)->len;
+    return 0;
+}
+
+void
+mio_mem (midi_io_t *io, mio_mem_t *m)
+{
+    if (io == NULL) return;
+
+    io->read = _mio_mem_read;
+    io->write = _mio_mem_write;
+    io->seek = _mio_mem_seek;
+    io->size = _mio_mem_size;
+    io->ctx = m;
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
@@ -92,6 +92,19 @@ int track_event_next (track_parser_t *p, track_event_t *e);
 #define MIDI_PARSER_IMPLEMENTATION
 #ifdef MIDI_PARSER_IMPLEMENTATION
 
+/* `track_event_next` checks every event against `p->len` before touching it, so malformed or hostile track data can't
+ * make it read out of bounds. Define `MIDI_PARSER_TRUSTED_INPUT` to drop those checks, for track data that has already
+ * been through the checked parser once (e.g. a cache of validated files) - on anything else it's undefined behavior. */
+#ifdef MIDI_PARSER_TRUSTED_INPUT
+#define _MIDI_PARSER_CHECK(cond) ((void)0)
+#else
+#define _MIDI_PARSER_CHECK(cond)                                                                                       \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond)) return -1;                                                                                        \
+    } while (0)
+#endif
+
 uint32_t
 track_event_get_storage_size (const track_event_t *e)
 {
@@ -338,12 +351,13 @@ midi_event_from_bytes_rolling (midi_event_t *e, uint8_t status, const uint8_t *b
 int
 track_event_next (track_parser_t *p, track_event_t *e)
 {
-    uint32_t delta;
+    uint32_t delta, vlength;
     uint32_t bytes_left = 0;
     int32_t ev_len = 0, n = 0;
     uint8_t b;
 
     if (p == NULL || e == NULL) return -1;
+    _MIDI_PARSER_CHECK (p->bytes != NULL && p->idx < p->len);
 
     if ((n = midi_vlq_decode (p->bytes + p->idx, p->len - p->idx, &delta)) <= 0) return -1;
 
@@ -351,7 +365,7 @@ track_event_next (track_parser_t *p, track_event_t *e)
     e->delta = delta;
 
     bytes_left = p->len - p->idx;
-    if (bytes_left == 0) return -1;
+    _MIDI_PARSER_CHECK (bytes_left > 0);
 
     b = p->bytes[p->idx];
 
@@ -364,20 +378,24 @@ track_event_next (track_parser_t *p, track_event_t *e)
     }
     else if (b == 0xF0 || b == 0xF7) /* SYSEX */
     {
-        uint32_t vlength;
-        if ((n = midi_vlq_decode (p->bytes + p->idx + 1, p->len - p->idx - 1, &vlength)) <= 0) return -1;
+        _MIDI_PARSER_CHECK (bytes_left >= 2);
+        if ((n = midi_vlq_decode (p->bytes + p->idx + 1, bytes_left - 1, &vlength)) <= 0) return -1;
+        _MIDI_PARSER_CHECK (vlength <= bytes_left - 1 - n);
 
         e->kind = EV_SYSEX;
         e->as.sysex.data = (const uint8_t *)p->bytes + p->idx + 1 + n;
-        e->as.sysex.length = vlength - 1;
+        e->as.sysex.length = vlength ? vlength - 1 : 0;
 
         ev_len = 1 + n + vlength;
     }
     else if (b == 0xFF) /* META */
     {
-        uint8_t type = p->bytes[p->idx + 1];
-        uint32_t vlength;
-        if ((n = midi_vlq_decode (p->bytes + p->idx + 2, p->len - p->idx - 2, &vlength)) <= 0) return -1;
+        uint8_t type;
+
+        _MIDI_PARSER_CHECK (bytes_left >= 3);
+        type = p->bytes[p->idx + 1];
+        if ((n = midi_vlq_decode (p->bytes + p->idx + 2, bytes_left - 2, &vlength)) <= 0) return -1;
+        _MIDI_PARSER_CHECK (vlength <= bytes_left - 2 - n);
 
         e->kind = EV_META;
         e->as.meta.type = type;
@@ -388,6 +406,7 @@ track_event_next (track_parser_t *p, track_event_t *e)
     }
     else
     {
+        _MIDI_PARSER_CHECK (b < 0x80); /* system common / real-time bytes are not valid in files */
         if (p->last_status >= 0x80 && p->last_status < 0xF0) /* rolling status */
         {
             ev_len = midi_event_from_bytes_rolling (&e->as.midi, p->last_status, (const uint8_t *)p->bytes + p->idx,
@@ -0,0 +1,510 @@
+/* MIDI-player - real-time event scheduler
+ * This header plays the tracks of a MIDI file in real time: events of all tracks are merged into a single stream
+ * ordered by tick, ticks are converted to absolute times using `tickdiv` and the tempo (0x51) meta events, and events
+ * are handed to an output callback when their time comes. Events sharing a tick are handed over together, as one
+ * batch.
+ * Every deadline is measured from the start of playback (not from the previous event), and waited for with
+ * `clock_nanosleep (TIMER_ABSTIME)`, so oversleeping once doesn't delay the rest of the song. Lateness of each batch is
+ * collected in `mp_stats_t`.
+ * The track merger (`mp_merge_*`) and the tempo map (`mp_tempo_*`) can be used on their own, without playing anything.
+ * The implementation uses POSIX clocks - compile it with `_GNU_SOURCE` defined before any system header.
+
+ * Example usage
+
+ ```c
+ static int
+ on_events (void *user, const mp_event_t *evs, uint32_t n)
+ {
+     // ... send evs[0 .. n-1] to the synth ...
+     return 0; // non-0 stops playback
+ }
+
+ midi_player_t mp = { 0 };
+
+ mp.out = on_events;
+ mp_begin (&mp, tracks, tracklens, ntracks, mr.tickdiv);
+ mp_play (&mp);
+ printf ("max lateness: %lu ns\n", (unsigned long)mp.stats.late_max_ns);
+ mp_end (&mp);
+ ```
+ */
+
+#ifndef MIDI_PLAYER_H
+#define MIDI_PLAYER_H
+
+#include "midi-parser.h"
+
+#include <stdint.h>
+
+#define MP_BATCH 64 /* max number of events handed to `out` at once */
+
+#define MP_DEFAULT_TEMPO 500000 /* microseconds per quarter note, until the first tempo event */
+
+/* Event of a merged stream */
+typedef struct
+{
+    track_event_t ev; /* `ev.delta` is the delta within its own track */
+    uint32_t tick;    /* absolute tick */
+    uint32_t track;   /* index of the track it comes from */
+    /* event bytes following the delta, as stored in the track (without status byte, if it used running status) */
+    const uint8_t *raw;
+    uint32_t raw_len;
+} mp_event_t;
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    /* internal state */
+    struct _mp_cursor *cursors;
+    uint32_t *heap; /* indices of `cursors`, ordered by (tick, track) */
+    uint32_t nheap;
+    int failed;
+} mp_merge_t;
+
+/* Tempo map segment - tempo in effect from `tick` on */
+typedef struct
+{
+    uint32_t tick;
+    uint32_t tempo; /* microseconds per quarter note */
+    uint64_t ns;    /* time of `tick` */
+} mp_tempo_seg_t;
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    mp_tempo_seg_t *segs;
+    uint32_t nsegs, cap;
+    uint16_t tickdiv; /* as in the file header; SMPTE based tickdivs (bit 15 set) ignore tempo */
+} mp_tempo_t;
+
+typedef struct
+{
+    uint32_t batches;     /* number of batches handed to `out` */
+    uint32_t events;      /* number of events handed to `out` */
+    uint32_t resyncs;     /* number of times the schedule was shifted (see `resync_ns`) */
+    uint64_t late_sum_ns; /* sum of lateness of all batches */
+    uint64_t late_max_ns; /* worst lateness of a batch */
+} mp_stats_t;
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    /* called with each batch of events sharing a tick, at its time; return non-0 to stop playback */
+    int (*out) (void *user, const mp_event_t *evs, uint32_t n);
+    void *user;
+    uint64_t spin_ns;   /* optional; busy-wait the last `spin_ns` before each deadline instead of sleeping */
+    uint64_t resync_ns; /* optional; if a batch is later than that, shift the rest of the song by its lateness */
+    mp_stats_t stats;   /* filled by `mp_play` */
+    /* internal state */
+    const uint8_t *const *tracks;
+    const uint32_t *lens;
+    uint32_t ntracks;
+    mp_tempo_t tempo;
+    mp_merge_t merge;
+    mp_event_t batch[MP_BATCH];
+} midi_player_t;
+
+/* Starts merging event data of `ntracks` tracks; Track data is not copied, it must outlive `m`;
+ * On success returns 0;
+ * On failure (NULL argument, out of memory) returns -1. */
+int mp_merge_begin (mp_merge_t *m, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks);
+
+/* Stores the next event of the merged stream in `out`; Events come ordered by tick, and events sharing a tick by
+ * track index (so events of a single track keep their order);
+ * On success returns 1;
+ * At end of all tracks returns 0;
+ * On failure (malformed event in any track, NULL argument) returns -1. */
+int mp_merge_next (mp_merge_t *m, mp_event_t *out);
+
+/* Releases memory held by the merger. */
+void mp_merge_end (mp_merge_t *m);
+
+/* Starts a tempo map with MP_DEFAULT_TEMPO at tick 0;
+ * On success returns 0;
+ * On failure (NULL argument, `tickdiv` is 0, out of memory) returns -1. */
+int mp_tempo_begin (mp_tempo_t *t, uint16_t tickdiv);
+
+/* Sets tempo `tempo` (microseconds per quarter note) from tick `tick` on; Ticks must come in non-decreasing order,
+ * and the last tempo set at a given tick wins;
+ * On success returns 0;
+ * On failure (out of order tick, `tempo` is 0, NULL argument, out of memory) returns -1. */
+int mp_tempo_add (mp_tempo_t *t, uint32_t tick, uint32_t tempo);
+
+/* Collects tempo events of all tracks into `t` (which must be started with `mp_tempo_begin`);
+ * On success returns 0;
+ * On failure (malformed event, NULL argument, out of memory) returns -1. */
+int mp_tempo_scan (mp_tempo_t *t, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks);
+
+/* Returns time of tick `tick`, in nanoseconds from tick 0. */
+uint64_t mp_tick_to_ns (const mp_tempo_t *t, uint32_t tick);
+
+/* Releases memory held by the tempo map. */
+void mp_tempo_end (mp_tempo_t *t);
+
+/* Prepares playback of `ntracks` tracks (merger and tempo map); Track data is not copied, it must outlive `mp`;
+ * `out` (and other settings) may be set before or after this call;
+ * On success returns 0;
+ * On failure (malformed event, NULL argument, `tickdiv` is 0, out of memory) returns -1. */
+int mp_begin (midi_player_t *mp, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks,
+              uint16_t tickdiv);
+
+/* Plays the song from the start, blocking until its end (or until `out` returns non-0); Resets `stats`;
+ * On success returns 0;
+ * On failure (malformed event, `out` not set, NULL argument, clock error) returns -1. */
+int mp_play (midi_player_t *mp);
+
+/* Releases memory held by the player. */
+void mp_end (midi_player_t *mp);
+
+#ifdef MIDI_PLAYER_IMPLEMENTATION
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct _mp_cursor
+{
+    track_parser_t tp;
+    mp_event_t next; /* next event of the track */
+};
+
+static int
+_mp_before (const mp_merge_t *m, uint32_t a, uint32_t b)
+{
+    const mp_event_t *x = &m->cursors[a].next, *y = &m->cursors[b].next;
+    return x->tick < y->tick || (x->tick == y->tick && x->track < y->track);
+}
+
+static void
+_mp_sift_down (mp_merge_t *m, uint32_t i)
+{
+    uint32_t c, tmp;
+
+    while ((c = 2 * i + 1) < m->nheap)
+    {
+        if (c + 1 < m->nheap && _mp_before (m, m->heap[c + 1], m->heap[c])) c += 1;
+        if (!_mp_before (m, m->heap[c], m->heap[i])) break;
+
+        tmp = m->heap[i];
+        m->heap[i] = m->heap[c];
+        m->heap[c] = tmp;
+        i = c;
+    }
+}
+
+/* Reads the next event of a track; returns 1, 0 at its end, or -1 */
+static int
+_mp_advance (struct _mp_cursor *c)
+{
+    uint32_t tick = c->next.tick;
+    int n;
+
+    if (c->tp.idx >= c->tp.len) return 0;
+    if ((n = track_event_next (&c->tp, &c->next.ev)) <= 0 || c->tp.idx > c->tp.len) return -1;
+    if (c->next.ev.delta > 0xFFFFFFFFU - tick) return -1;
+
+    c->next.tick = tick + c->next.ev.delta;
+    c->next.raw = c->tp.bytes + c->tp.idx - n;
+    c->next.raw_len = n;
+    return 1;
+}
+
+int
+mp_merge_begin (mp_merge_t *m, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks)
+{
+    uint32_t i;
+    int n;
+
+    if (m == NULL || (ntracks > 0 && (tracks == NULL || lens == NULL))) return -1;
+
+    memset (m, 0, sizeof *m);
+    m->cursors = calloc (ntracks ? ntracks : 1, sizeof *m->cursors);
+    m->heap = malloc ((ntracks ? ntracks : 1) * sizeof *m->heap);
+    if (m->cursors == NULL || m->heap == NULL)
+    {
+        mp_merge_end (m);
+        return -1;
+    }
+
+    for (i = 0; i < ntracks; ++i)
+    {
+        m->cursors[i].tp.bytes = tracks[i];
+        m->cursors[i].tp.len = tracks[i] ? lens[i] : 0;
+        m->cursors[i].next.track = i;
+
+        if ((n = _mp_advance (&m->cursors[i])) < 0) m->failed = 1;
+        if (n > 0) m->heap[m->nheap++] = i;
+    }
+
+    /* tracks were pushed in index order - only ticks can break the heap */
+    for (i = m->nheap / 2; i-- > 0;) _mp_sift_down (m, i);
+
+    return 0;
+}
+
+int
+mp_merge_next (mp_merge_t *m, mp_event_t *out)
+{
+    struct _mp_cursor *c;
+    int n;
+
+    if (m == NULL || out == NULL || m->failed) return -1;
+    if (m->nheap == 0) return 0;
+
+    c = &m->cursors[m->heap[0]];
+    *out = c->next;
+
+    if ((n = _mp_advance (c)) < 0)
+    {
+        m->failed = 1;
+        return -1;
+    }
+    if (n == 0) m->heap[0] = m->heap[--m->nheap];
+    _mp_sift_down (m, 0);
+
+    return 1;
+}
+
+void
+mp_merge_end (mp_merge_t *m)
+{
+    if (m == NULL) return;
+
+    free (m->cursors);
+    free (m->heap);
+    memset (m, 0, sizeof *m);
+}
+
+int
+mp_tempo_begin (mp_tempo_t *t, uint16_t tickdiv)
+{
+    if (t == NULL || tickdiv == 0 || ((tickdiv & 0x8000) && (tickdiv & 0xFF) == 0)) return -1;
+
+    t->nsegs = 0;
+    t->tickdiv = tickdiv;
+    return mp_tempo_add (t, 0, MP_DEFAULT_TEMPO);
+}
+
+int
+mp_tempo_add (mp_tempo_t *t, uint32_t tick, uint32_t tempo)
+{
+    mp_tempo_seg_t *p;
+    uint32_t cap;
+
+    if (t == NULL || tempo == 0) return -1;
+    if (t->nsegs > 0 && tick < t->segs[t->nsegs - 1].tick) return -1;
+
+    if (t->nsegs > 0 && tick == t->segs[t->nsegs - 1].tick)
+    {
+        t->segs[t->nsegs - 1].tempo = tempo;
+        return 0;
+    }
+
+    if (t->nsegs == t->cap)
+    {
+        cap = t->cap ? t->cap * 2 : 16;
+        if ((p = realloc (t->segs, cap * sizeof *p)) == NULL) return -1;
+        t->segs = p;
+        t->cap = cap;
+    }
+
+    t->segs[t->nsegs].tick = tick;
+    t->segs[t->nsegs].tempo = tempo;
+    t->segs[t->nsegs].ns = t->nsegs ? mp_tick_to_ns (t, tick) : 0;
+    t->nsegs += 1;
+
+    return 0;
+}
+
+int
+mp_tempo_scan (mp_tempo_t *t, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks)
+{
+    mp_merge_t m;
+    mp_event_t e;
+    const uint8_t *d;
+    int n;
+
+    if (t == NULL || mp_merge_begin (&m, tracks, lens, ntracks) != 0) return -1;
+
+    while ((n = mp_merge_next (&m, &e)) > 0)
+    {
+        if (e.ev.kind != EV_META || e.ev.as.meta.type != 0x51 || e.ev.as.meta.length != 3) continue;
+
+        d = e.ev.as.meta.data;
+        if (mp_tempo_add (t, e.tick, (uint32_t)d[0] << 16 | (uint32_t)d[1] << 8 | d[2]) != 0) n = -1;
+        if (n < 0) break;
+    }
+
+    mp_merge_end (&m);
+    return n < 0 ? -1 : 0;
+}
+
+/* Time of `tick` within segment `s` */
+static uint64_t
+_mp_seg_ns (const mp_tempo_t *t, const mp_tempo_seg_t *s, uint32_t tick)
+{
+    uint32_t dt = tick - s->tick;
+
+    /* whole quarter notes and the rest separately, so that the product can't overflow */
+    return s->ns + (uint64_t)(dt / t->tickdiv) * s->tempo * 1000
+           + (uint64_t)(dt % t->tickdiv) * s->tempo * 1000 / t->tickdiv;
+}
+
+/* Time of `tick` for SMPTE based tickdivs - frames per second (29 is 29.97 drop frame) times ticks per frame */
+static uint64_t
+_mp_smpte_ns (const mp_tempo_t *t, uint32_t tick)
+{
+    uint32_t fps = 256 - (t->tickdiv >> 8), tpf = t->tickdiv & 0xFF;
+
+    if (fps == 29) return (uint64_t)tick * 1001000000 / (30 * tpf);
+    return (uint64_t)tick * 1000000000 / (fps * tpf);
+}
+
+uint64_t
+mp_tick_to_ns (const mp_tempo_t *t, uint32_t tick)
+{
+    uint32_t lo = 0, hi, mid;
+
+    if (t == NULL || t->nsegs == 0) return 0;
+    if (t->tickdiv & 0x8000) return _mp_smpte_ns (t, tick);
+
+    /* last segment starting at or before `tick` */
+    hi = t->nsegs;
+    while (hi - lo > 1)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (t->segs[mid].tick <= tick)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return _mp_seg_ns (t, &t->segs[lo], tick);
+}
+
+void
+mp_tempo_end (mp_tempo_t *t)
+{
+    if (t == NULL) return;
+
+    free (t->segs);
+    memset (t, 0, sizeof *t);
+}
+
+int
+mp_begin (midi_player_t *mp, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks, uint16_t tickdiv)
+{
+    if (mp == NULL) return -1;
+
+    mp->tracks = tracks;
+    mp->lens = lens;
+    mp->ntracks = ntracks;
+
+    if (mp_tempo_begin (&mp->tempo, tickdiv) != 0 || mp_tempo_scan (&mp->tempo, tracks, lens, ntracks) != 0)
+    {
+        mp_tempo_end (&mp->tempo);
+        return -1;
+    }
+
+    return 0;
+}
+
+static uint64_t
+_mp_now (void)
+{
+    struct timespec ts;
+
+    if (clock_gettime (CLOCK_MONOTONIC, &ts) != 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Waits until `deadline` (CLOCK_MONOTONIC, in ns); returns current time, or 0 on failure */
+static uint64_t
+_mp_wait (const midi_player_t *mp, uint64_t deadline)
+{
+    struct timespec ts;
+    uint64_t wake = deadline > mp->spin_ns ? deadline - mp->spin_ns : 0, now;
+    int r;
+
+    ts.tv_sec = wake / 1000000000;
+    ts.tv_nsec = wake % 1000000000;
+    while ((r = clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) == EINTR)
+        ;
+    if (r != 0) return 0;
+
+    do
+    {
+        if ((now = _mp_now ()) == 0) return 0;
+    } while (now < deadline);
+
+    return now;
+}
+
+int
+mp_play (midi_player_t *mp)
+{
+    mp_event_t e;
+    uint64_t start, deadline, now, late;
+    uint32_t seg = 0, n, tick;
+    int have;
+
+    if (mp == NULL || mp->out == NULL || mp->tempo.nsegs == 0) return -1;
+
+    memset (&mp->stats, 0, sizeof mp->stats);
+    mp_merge_end (&mp->merge);
+    if (mp_merge_begin (&mp->merge, mp->tracks, mp->lens, mp->ntracks) != 0) return -1;
+    if ((start = _mp_now ()) == 0) return -1;
+
+    have = mp_merge_next (&mp->merge, &e);
+    while (have > 0)
+    {
+        /* collect a batch of events sharing a tick */
+        tick = e.tick;
+        for (n = 0; have > 0 && e.tick == tick && n < MP_BATCH; ++n)
+        {
+            mp->batch[n] = e;
+            have = mp_merge_next (&mp->merge, &e);
+        }
+        if (have < 0) return -1;
+
+        /* ticks only grow - the tempo segment can be tracked instead of searched for */
+        if (mp->tempo.tickdiv & 0x8000)
+            deadline = start + _mp_smpte_ns (&mp->tempo, tick);
+        else
+        {
+            while (seg + 1 < mp->tempo.nsegs && mp->tempo.segs[seg + 1].tick <= tick) ++seg;
+            deadline = start + _mp_seg_ns (&mp->tempo, &mp->tempo.segs[seg], tick);
+        }
+
+        if ((now = _mp_wait (mp, deadline)) == 0) return -1;
+
+        late = now - deadline;
+        mp->stats.late_sum_ns += late;
+        if (late > mp->stats.late_max_ns) mp->stats.late_max_ns = late;
+        if (mp->resync_ns && late > mp->resync_ns)
+        {
+            start += late;
+            mp->stats.resyncs += 1;
+        }
+
+        mp->stats.batches += 1;
+        mp->stats.events += n;
+        if (mp->out (mp->user, mp->batch, n) != 0) break;
+    }
+
+    return 0;
+}
+
+void
+mp_end (midi_player_t *mp)
+{
+    if (mp == NULL) return;
+
+    mp_merge_end (&mp->merge);
+    mp_tempo_end (&mp->tempo);
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
@@ -76,6 +76,8 @@
 #ifndef MIDI_READER_H
 #define MIDI_READER_H
 
+#include "midi-io.h"
+
 #include <stdint.h>
 #include <stdio.h>
 
@@ -83,10 +85,12 @@
 typedef struct
 {
     /* parser state */
-    FILE *src;   /* source file */
-    uint32_t i;  /* current file offset */
-    int eotrack; /* 1 - end of track reached; 0 otherwise */
-    int eof;     /* 1 - end of file reached; 0 otherwise */
+    midi_io_t io;  /* source */
+    FILE *src;     /* source file, if started with `mr_begin`; NULL otherwise */
+    uint32_t i;    /* current file offset, counted from where reading started */
+    uint32_t size; /* size of source, if `io.size` is set; 0 otherwise */
+    int eotrack;   /* 1 - end of track reached; 0 otherwise */
+    int eof;       /* 1 - end of file reached; 0 otherwise */
     /* header info */
     uint16_t ntracks; /* number of tracks in file */
     uint16_t format;  /* file format */
@@ -102,6 +106,13 @@ typedef struct
  * anywhere. You may check `errno` for any system errors, but it's not guaranteed to be set; */
 int mr_begin (midi_reader_t *mr, FILE *src);
 
+/* Same as `mr_begin`, but reads through `io` instead of a file; `io` is copied into the reader context.
+ * Only `io->read` is required. If `io->size` is set, tracks claiming to be longer than the rest of the source are
+ * rejected by `mr_next_track`, so track buffers can be allocated without trusting the file; `io->size` reports the
+ * whole source, while the reader counts from where `io` stands now, so the source must be at offset 0 (the start of
+ * the MIDI file) for the check to be exact - further in, it is looser by the starting offset. */
+int mr_begin_io (midi_reader_t *mr, const midi_io_t *io);
+
 /* Reads from source file, until track marker is encoutered; Parses track length in bytes;
  * On failure (reached eof before finding marker, etc.) returns 0;
  * On success returns track length in bytes (non-0 for any valid MIDI file); */
@@ -119,63 +130,94 @@ void mr_end (midi_reader_t *mr);
 
 #ifdef MIDI_READER_IMPLEMENTATION
 
+static int32_t
+_mr_file_read (void *ctx, uint8_t *buf, uint32_t len)
+{
+    size_t n = fread (buf, 1, len, ctx);
+    if (n == 0 && ferror ((FILE *)ctx)) return -1;
+    return n;
+}
+
+/* Reads exactly `len` bytes, unless source runs out; returns number of bytes read */
+static uint32_t
+_mr_read (midi_reader_t *mr, uint8_t *buf, uint32_t len)
+{
+    uint32_t total = 0;
+    int32_t n;
+
+    while (total < len)
+    {
+        n = mr->io.read (mr->io.ctx, buf + total, len - total);
+        if (n <= 0)
+        {
+            if (n == 0) mr->eof = 1;
+            break;
+        }
+        total += n;
+    }
+
+    mr->i += total;
+    return total;
+}
+
 static int
 _mr_read_u32 (midi_reader_t *mr, uint32_t *out_u32)
 {
     uint8_t b[4];
-    uint32_t n = fread (b, 1, 4, mr->src);
-    mr->i += n;
-    if (n != 4)
-    {
-        if (feof (mr->src)) mr->eof = 1;
-        return n - 4;
-    }
-    *out_u32 = b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3];
-    return n - 4;
+    uint32_t n = _mr_read (mr, b, 4);
+    if (n != 4) return n - 4;
+    *out_u32 = (uint32_t)b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3];
+    return 0;
 }
 
 static int
 _mr_read_u16 (midi_reader_t *mr, uint16_t *out_u16)
 {
     uint8_t b[2];
-    uint32_t n = fread (b, 1, 2, mr->src);
-    mr->i += n;
-    if (n != 2)
-    {
-        if (feof (mr->src)) mr->eof = 1;
-
-        return n - 2;
-    }
+    uint32_t n = _mr_read (mr, b, 2);
+    if (n != 2) return n - 2;
     *out_u16 = b[0] << 8 | b[1];
-    return n - 2;
+    return 0;
 }
 
 static int
 _mr_read_u8 (midi_reader_t *mr, uint8_t *out_u8)
 {
-    uint8_t b;
-    uint32_t n = fread (&b, 1, 1, mr->src);
-    mr->i += n;
-    if (n != 1)
-    {
-        if (feof (mr->src)) mr->eof = 1;
-
-        return n - 1;
-    }
-    *out_u8 = b;
-    return n - 1;
+    return _mr_read (mr, out_u8, 1) - 1;
 }
 
 int
 mr_begin (midi_reader_t *mr, FILE *src)
+{
+    midi_io_t io;
+
+    if (mr == NULL || src == NULL) return -1;
+
+    io.read = _mr_file_read;
+    io.write = NULL;
+    io.seek = NULL;
+    io.size = NULL;
+    io.ctx = src;
+
+    if (mr_begin_io (mr, &io) != 0) return -1;
+    mr->src = src;
+
+    return 0;
+}
+
+int
+mr_begin_io (midi_reader_t *mr, const midi_io_t *io)
 {
     uint32_t magic;
     uint32_t header_len;
 
-    if (mr == NULL) return -1;
+    if (mr == NULL || io == NULL || io->read == NULL) return -1;
 
-    mr->src = src;
+    mr->io = *io;
+    mr->src = NULL;
     mr->i = 0;
+    mr->size = 0;
+    if (io->size && io->size (io->ctx, &mr->size) != 0) return -1;
     mr->eof = 0;
     mr->eotrack = 0;
     mr->track_idx = -1;
@@ -200,7 +242,7 @@ error:
 uint32_t
 mr_next_track (midi_reader_t *mr)
 {
-    char b[4] = { 0 };
+    uint8_t b[4] = { 0 };
     uint8_t c;
     uint32_t track_len;
 
@@ -216,10 +258,11 @@ mr_next_track (midi_reader_t *mr)
         b[2] = b[3];
         b[3] = c;
 
-        if ((uint32_t)(b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3]) == 0x4D54726B) break;
+        if (((uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8 | b[3]) == 0x4D54726B) break;
     }
 
     if (_mr_read_u32 (mr, &track_len) != 0) return 0;
+    if (mr->io.size && (mr->i > mr->size || track_len > mr->size - mr->i)) return 0;
 
     mr->track_idx += 1;
     mr->track_len = track_len;
@@ -230,18 +273,20 @@ mr_next_track (midi_reader_t *mr)
 int
 mr_get_track_data (midi_reader_t *mr, uint8_t *out_data)
 {
-    uint8_t c;
-    uint32_t i;
+    uint8_t skip[256];
+    uint32_t i, n;
 
     if (mr == NULL) return -1;
     if (mr->eotrack) return -1;
     if (mr->eof) return -1;
     if (mr->track_len == 0) return -1;
 
-    for (i = 0; i < mr->track_len; ++i)
+    if (out_data) return _mr_read (mr, out_data, mr->track_len) == mr->track_len ? 0 : -1;
+
+    for (i = 0; i < mr->track_len; i += n)
     {
-        if (_mr_read_u8 (mr, &c) != 0) return -1;
-        if (out_data) out_data[i] = c;
+        n = mr->track_len - i < sizeof skip ? mr->track_len - i : sizeof skip;
+        if (_mr_read (mr, skip, n) != n) return -1;
     }
 
     return 0;
@@ -0,0 +1,459 @@
+/* MIDI-render - offline MIDI to audio renderer
+ * This header renders MIDI files to mono 16-bit PCM (raw, or as a WAV file), faster than real time, with a small
+ * built-in synthesizer: a pool of MS_VOICES wavetable voices (a sine by default), each with a simple decaying
+ * envelope. It handles note on / off, pitch bend, channel volume (CC 7) and sustain pedal (CC 64); every program
+ * sounds the same, and channel 10 (percussion) is not played.
+ * Voices are rendered in blocks of up to MS_BLOCK frames, so events land on the exact frame they are due at. Nothing is
+ * allocated while rendering - a note on takes a free voice, or steals the quietest one.
+ * Voice mixing uses AVX2 when the compiler targets it (`-mavx2`), and plain loops otherwise. Define
+ * `MIDI_RENDER_NO_SIMD` to force the plain loops.
+ * Tracks are merged and timed with `mp_merge_*` and `mp_tempo_*` from midi-player, and the implementation uses `sin`
+ * and `pow` - link with `-lm`.
+
+ * Example usage
+
+ ```c
+ static midi_synth_t ms; // large - better not on the stack
+ midi_io_t io;
+
+ mio_file (&io, fopen ("preview.wav", "wb"));
+ ms_begin (&ms, 44100);
+ ms_render_file (&ms, tracks, tracklens, ntracks, mr.tickdiv, 30 * 44100, &io); // first 30 seconds
+ ```
+ */
+
+#ifndef MIDI_RENDER_H
+#define MIDI_RENDER_H
+
+#include "midi-io.h"
+#include "midi-parser.h"
+#include "midi-player.h"
+
+#include <stdint.h>
+
+#define MS_VOICES 64 /* max number of notes sounding at once */
+#define MS_BLOCK 256 /* max number of frames rendered at once */
+#define MS_MAX_FRAMES ((0xFFFFFFFFU - 44) / 2) /* longest render whose WAV data fits the 32-bit RIFF sizes */
+#define MS_TABLE_BITS 12
+#define MS_TABLE_LEN (1 << MS_TABLE_BITS)
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    uint32_t rate; /* frames per second */
+    float gain;    /* output gain, 0.25 by default */
+    float hold;    /* seconds it takes a held note to fade by 60 dB, 4 by default; set before `ms_begin` */
+    float release; /* seconds it takes a released note to fade by 60 dB, 0.1 by default; set before `ms_begin` */
+    float table[MS_TABLE_LEN]; /* one cycle of the waveform; a sine by default, may be overwritten after `ms_begin` */
+    /* voices */
+    uint32_t phase[MS_VOICES];
+    uint32_t inc[MS_VOICES];   /* phase increment per frame */
+    float amp[MS_VOICES];      /* amplitude at the start of the next block */
+    float level[MS_VOICES];    /* amplitude the envelope is at (`amp` ramps to it, to avoid clicks) */
+    uint8_t state[MS_VOICES];  /* _MS_* */
+    uint8_t note[MS_VOICES];
+    uint8_t channel[MS_VOICES];
+    /* channels */
+    float volume[16];
+    float bend[16]; /* pitch bend, as a frequency ratio */
+    uint8_t pedal[16];
+    /* internal state */
+    uint32_t note_inc[128];
+    float hold_mul[MS_BLOCK], release_mul[MS_BLOCK]; /* envelope multipliers for 1 .. MS_BLOCK frames */
+    float buf[MS_BLOCK];
+} midi_synth_t;
+
+/* Initializes the synthesizer (all voices silent) for `rate` frames per second;
+ * On success returns 0;
+ * On failure (NULL argument, `rate` outside 8000 .. 384000) returns -1. */
+int ms_begin (midi_synth_t *ms, uint32_t rate);
+
+/* Applies a channel event (note on / off, controller, pitch bend) to the synthesizer; Other events are ignored. */
+void ms_event (midi_synth_t *ms, const track_event_t *e);
+
+/* Renders the next `frames` frames into `out`; Returns number of voices still sounding. */
+uint32_t ms_render (midi_synth_t *ms, int16_t *out, uint32_t frames);
+
+/* Renders `ntracks` tracks of a file, and writes them to `io` as a WAV file; Rendering stops after `max_frames` frames
+ * (0 - no limit; at most MS_MAX_FRAMES, which fills a WAV file), or once all notes have faded after the end of the
+ * song;
+ * If `io` can seek, the WAV header holds the actual length, otherwise it is set to the largest possible one (as
+ * streaming WAV writers do);
+ * On success returns number of frames written;
+ * On failure (malformed event, write error, NULL argument, `tickdiv` is 0, out of memory) returns -1. */
+int32_t ms_render_file (midi_synth_t *ms, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks,
+                        uint16_t tickdiv, uint32_t max_frames, const midi_io_t *io);
+
+#ifdef MIDI_RENDER_IMPLEMENTATION
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__AVX2__) && !defined(MIDI_RENDER_NO_SIMD)
+#define MIDI_RENDER_AVX2
+#include <immintrin.h>
+#endif
+
+#define _MS_FREE 0
+#define _MS_HELD 1      /* key down */
+#define _MS_SUSTAINED 2 /* key up, pedal down */
+#define _MS_RELEASED 3  /* fading out */
+
+#define _MS_SILENCE 0.0001f /* voices quieter than that are freed */
+
+int
+ms_begin (midi_synth_t *ms, uint32_t rate)
+{
+    double f, hold, release;
+    int j;
+
+    if (ms == NULL || rate < 8000 || rate > 384000) return -1;
+
+    memset (ms->state, _MS_FREE, sizeof ms->state);
+    memset (ms->amp, 0, sizeof ms->amp);
+    memset (ms->pedal, 0, sizeof ms->pedal);
+
+    ms->rate = rate;
+    if (ms->gain == 0) ms->gain = 0.25f;
+    if (ms->hold == 0) ms->hold = 4;
+    if (ms->release == 0) ms->release = 0.1f;
+
+    hold = pow (0.001, 1.0 / rate / ms->hold);
+    release = pow (0.001, 1.0 / rate / ms->release);
+    for (j = 0, f = 1; j < MS_BLOCK; ++j) ms->hold_mul[j] = f *= hold;
+    for (j = 0, f = 1; j < MS_BLOCK; ++j) ms->release_mul[j] = f *= release;
+
+    for (j = 0; j < MS_TABLE_LEN; ++j) ms->table[j] = sin (2 * 3.14159265358979323846 * j / MS_TABLE_LEN);
+    for (j = 0; j < 16; ++j)
+    {
+        ms->volume[j] = 100 / 127.0f;
+        ms->bend[j] = 1;
+    }
+    for (j = 0; j < 128; ++j)
+    {
+        /* notes above Nyquist are silent, rather than aliased */
+        f = 440 * pow (2, (j - 69) / 12.0) / rate;
+        ms->note_inc[j] = f < 0.5 ? (uint32_t)(f * 4294967296.0) : 0;
+    }
+
+    return 0;
+}
+
+static void
+_ms_retune (midi_synth_t *ms, int v)
+{
+    double inc = (double)ms->note_inc[ms->note[v]] * ms->bend[ms->channel[v]];
+    ms->inc[v] = inc < 2147483648.0 ? (uint32_t)inc : 0;
+}
+
+static void
+_ms_note_on (midi_synth_t *ms, uint8_t ch, uint8_t note, uint8_t velocity)
+{
+    int v, pick = -1;
+
+    /* same note on the same channel first, then a free voice, then the quietest one */
+    for (v = 0; v < MS_VOICES; ++v)
+        if (ms->state[v] != _MS_FREE && ms->channel[v] == ch && ms->note[v] == note)
+        {
+            pick = v;
+            break;
+        }
+    for (v = 0; v < MS_VOICES && pick < 0; ++v)
+        if (ms->state[v] == _MS_FREE) pick = v;
+    if (pick < 0)
+        for (v = pick = 0; v < MS_VOICES; ++v)
+            if (ms->level[v] < ms->level[pick]) pick = v;
+
+    if (ms->state[pick] == _MS_FREE)
+    {
+        ms->phase[pick] = 0;
+        ms->amp[pick] = 0;
+    }
+    ms->state[pick] = _MS_HELD;
+    ms->note[pick] = note;
+    ms->channel[pick] = ch;
+    ms->level[pick] = velocity / 127.0f * ms->volume[ch];
+    _ms_retune (ms, pick);
+}
+
+static void
+_ms_note_off (midi_synth_t *ms, uint8_t ch, uint8_t note)
+{
+    int v;
+
+    for (v = 0; v < MS_VOICES; ++v)
+        if (ms->state[v] == _MS_HELD && ms->channel[v] == ch && ms->note[v] == note)
+            ms->state[v] = ms->pedal[ch] ? _MS_SUSTAINED : _MS_RELEASED;
+}
+
+void
+ms_event (midi_synth_t *ms, const track_event_t *e)
+{
+    const midi_event_t *m;
+    uint8_t ch;
+    int v;
+
+    if (ms == NULL || e == NULL || e->kind != EV_MIDI) return;
+
+    m = &e->as.midi;
+    ch = m->channel & 0x0F;
+    if (ch == 9) return;
+
+    switch (m->kind)
+    {
+    case MIDI_NOTE_ON:
+        if (m->as.note_on.velocity > 0)
+        {
+            _ms_note_on (ms, ch, m->as.note_on.note & 0x7F, m->as.note_on.velocity & 0x7F);
+            break;
+        }
+        /* fall through */
+    case MIDI_NOTE_OFF: _ms_note_off (ms, ch, m->as.note_off.note & 0x7F); break;
+    case MIDI_PITCH_BEND:
+        ms->bend[ch] = pow (2, ((int)(m->as.pitch_bend & 0x3FFF) - 8192) / 8192.0 * 2 / 12);
+        for (v = 0; v < MS_VOICES; ++v)
+            if (ms->state[v] != _MS_FREE && ms->channel[v] == ch) _ms_retune (ms, v);
+        break;
+    case MIDI_CONTROLLER:
+        switch (m->as.controller.controller)
+        {
+        case 7: ms->volume[ch] = (m->as.controller.value & 0x7F) / 127.0f; break;
+        case 64:
+            ms->pedal[ch] = m->as.controller.value >= 64;
+            if (ms->pedal[ch]) break;
+            for (v = 0; v < MS_VOICES; ++v)
+                if (ms->state[v] == _MS_SUSTAINED && ms->channel[v] == ch) ms->state[v] = _MS_RELEASED;
+            break;
+        case 120: /* all sound off */
+        case 123: /* all notes off */
+            for (v = 0; v < MS_VOICES; ++v)
+                if (ms->state[v] != _MS_FREE && ms->channel[v] == ch) ms->state[v] = _MS_RELEASED;
+            break;
+        }
+        break;
+    }
+}
+
+/* Adds `n` frames of voice `v` to `buf`, with amplitude ramping linearly from `a` by `d` per frame */
+static void
+_ms_voice (midi_synth_t *ms, int v, float *buf, uint32_t n, float a, float d)
+{
+    uint32_t phase = ms->phase[v], inc = ms->inc[v], i = 0;
+
+#ifdef MIDI_RENDER_AVX2
+    __m256i lanes = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7), phases, step;
+    __m256 amps, astep, s;
+
+    /* 8 consecutive frames at once */
+    phases = _mm256_add_epi32 (_mm256_set1_epi32 (phase), _mm256_mullo_epi32 (_mm256_set1_epi32 (inc), lanes));
+    step = _mm256_set1_epi32 (inc * 8);
+    amps = _mm256_add_ps (_mm256_set1_ps (a), _mm256_mul_ps (_mm256_set1_ps (d), _mm256_cvtepi32_ps (lanes)));
+    astep = _mm256_set1_ps (d * 8);
+
+    for (; i + 8 <= n; i += 8)
+    {
+        s = _mm256_i32gather_ps (ms->table, _mm256_srli_epi32 (phases, 32 - MS_TABLE_BITS), 4);
+        _mm256_storeu_ps (buf + i, _mm256_add_ps (_mm256_loadu_ps (buf + i), _mm256_mul_ps (s, amps)));
+        phases = _mm256_add_epi32 (phases, step);
+        amps = _mm256_add_ps (amps, astep);
+    }
+    phase += inc * i;
+    a += d * i;
+#endif
+
+    for (; i < n; ++i)
+    {
+        buf[i] += ms->table[phase >> (32 - MS_TABLE_BITS)] * a;
+        phase += inc;
+        a += d;
+    }
+
+    ms->phase[v] = phase;
+}
+
+/* Renders up to MS_BLOCK frames into `buf`; returns number of voices still sounding */
+static uint32_t
+_ms_block (midi_synth_t *ms, uint32_t n)
+{
+    uint32_t active = 0;
+    float end;
+    int v;
+
+    memset (ms->buf, 0, n * sizeof *ms->buf);
+
+    for (v = 0; v < MS_VOICES; ++v)
+    {
+        if (ms->state[v] == _MS_FREE) continue;
+
+        /* exponential decay, applied once per block; fades by 60 dB in `hold` / `release` seconds */
+        ms->level[v] *= ms->state[v] == _MS_RELEASED ? ms->release_mul[n - 1] : ms->hold_mul[n - 1];
+        end = ms->level[v];
+
+        _ms_voice (ms, v, ms->buf, n, ms->amp[v], (end - ms->amp[v]) / n);
+        ms->amp[v] = end;
+
+        if (end < _MS_SILENCE)
+            ms->state[v] = _MS_FREE;
+        else
+            active += 1;
+    }
+
+    return active;
+}
+
+uint32_t
+ms_render (midi_synth_t *ms, int16_t *out, uint32_t frames)
+{
+    uint32_t n, i, active = 0;
+    float s;
+
+    if (ms == NULL || out == NULL) return 0;
+
+    while (frames > 0)
+    {
+        n = frames < MS_BLOCK ? frames : MS_BLOCK;
+        active = _ms_block (ms, n);
+
+        for (i = 0; i < n; ++i)
+        {
+            s = ms->buf[i] * ms->gain * 32767;
+            out[i] = s >= 32767 ? 32767 : s <= -32768 ? -32768 : (int16_t)s;
+        }
+
+        out += n;
+        frames -= n;
+    }
+
+    return active;
+}
+
+static int
+_ms_write (const midi_io_t *io, const uint8_t *buf, uint32_t len)
+{
+    int32_t n;
+
+    while (len > 0)
+    {
+        if ((n = io->write (io->ctx, buf, len)) <= 0) return -1;
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static void
+_ms_put_u32 (uint8_t *b, uint32_t v)
+{
+    b[0] = v;
+    b[1] = v >> 8;
+    b[2] = v >> 16;
+    b[3] = v >> 24;
+}
+
+static int
+_ms_wav_header (const midi_io_t *io, uint32_t rate, uint32_t frames)
+{
+    uint8_t h[44];
+    uint32_t data_len = frames > (0xFFFFFFFFU - 36) / 2 ? 0xFFFFFFFFU - 36 : frames * 2;
+
+    memcpy (h, "RIFF", 4);
+    _ms_put_u32 (h + 4, 36 + data_len);
+    memcpy (h + 8, "WAVEfmt ", 8);
+    _ms_put_u32 (h + 16, 16);
+    _ms_put_u32 (h + 20, 1 | 1 << 16); /* PCM, mono */
+    _ms_put_u32 (h + 24, rate);
+    _ms_put_u32 (h + 28, rate * 2);
+    _ms_put_u32 (h + 32, 2 | 16 << 16); /* 2 bytes per frame, 16 bits per sample */
+    memcpy (h + 36, "data", 4);
+    _ms_put_u32 (h + 40, data_len);
+
+    return _ms_write (io, h, 44);
+}
+
+/* Renders and writes `frames` frames; returns number of voices still sounding, or -1 on write error */
+static int32_t
+_ms_emit (midi_synth_t *ms, const midi_io_t *io, uint32_t frames)
+{
+    int16_t pcm[MS_BLOCK];
+    uint8_t bytes[2 * MS_BLOCK];
+    uint32_t n, i, active = 0;
+
+    while (frames > 0)
+    {
+        n = frames < MS_BLOCK ? frames : MS_BLOCK;
+        active = ms_render (ms, pcm, n);
+
+        for (i = 0; i < n; ++i)
+        {
+            bytes[2 * i] = (uint16_t)pcm[i];
+            bytes[2 * i + 1] = (uint16_t)pcm[i] >> 8;
+        }
+        if (_ms_write (io, bytes, 2 * n) != 0) return -1;
+
+        frames -= n;
+    }
+
+    return active;
+}
+
+int32_t
+ms_render_file (midi_synth_t *ms, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks,
+                uint16_t tickdiv, uint32_t max_frames, const midi_io_t *io)
+{
+    mp_tempo_t tempo = { 0 };
+    mp_merge_t merge = { 0 };
+    mp_event_t e;
+    uint64_t at;
+    uint32_t pos = 0, tail;
+    int32_t status = -1, active = 0;
+    int have;
+
+    if (ms == NULL || io == NULL || io->write == NULL || ms->rate == 0) return -1;
+    if (max_frames == 0 || max_frames > MS_MAX_FRAMES) max_frames = MS_MAX_FRAMES;
+
+    if (mp_tempo_begin (&tempo, tickdiv) != 0 || mp_tempo_scan (&tempo, tracks, lens, ntracks) != 0) goto end;
+    if (mp_merge_begin (&merge, tracks, lens, ntracks) != 0) goto end;
+    if (_ms_wav_header (io, ms->rate, io->seek ? 0 : 0xFFFFFFFFU) != 0) goto end;
+
+    while (pos < max_frames && (have = mp_merge_next (&merge, &e)) != 0)
+    {
+        if (have < 0) goto end;
+
+        at = mp_tick_to_ns (&tempo, e.tick) / 1000 * ms->rate / 1000000;
+        if (at > max_frames) at = max_frames;
+
+        if (at > pos)
+        {
+            if ((active = _ms_emit (ms, io, at - pos)) < 0) goto end;
+            pos = at;
+        }
+        if (pos < max_frames) ms_event (ms, &e.ev);
+    }
+
+    /* let the notes ring out - held ones fade too, so this ends */
+    active = 1;
+    while (pos < max_frames && active != 0)
+    {
+        tail = max_frames - pos < MS_BLOCK ? max_frames - pos : MS_BLOCK;
+        if ((active = _ms_emit (ms, io, tail)) < 0) goto end;
+        pos += tail;
+    }
+
+    if (io->seek)
+    {
+        if (io->seek (io->ctx, 0) != 0 || _ms_wav_header (io, ms->rate, pos) != 0) goto end;
+        if (io->seek (io->ctx, 44 + 2 * pos) != 0) goto end;
+    }
+
+    status = pos;
+
+end:
+    mp_merge_end (&merge);
+    mp_tempo_end (&tempo);
+    return status;
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
@@ -0,0 +1,205 @@
+/* MIDI-rewriter - streaming, allocation-free track rewriter
+ * This header applies simple edits (dropping sysex / text meta / arbitrary events, changing channels) to raw track
+ * data, without materializing events. Runs of unchanged events are copied with a single `memmove`; only events that
+ * change (or follow a dropped event) are re-encoded. Deltas of dropped events are carried over to the next kept event,
+ * and running status is repaired where a dropped event had set it.
+ * Output is never longer than input, so tracks (and whole files) can be rewritten in place.
+
+ * Example usage
+
+ ```c
+ midi_rewrite_t rw = { 0 };
+ uint8_t chmap[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+ int32_t n;
+
+ chmap[9] = 15;
+ rw.flags = RW_DROP_SYSEX | RW_DROP_TEXT;
+ rw.channel_map = chmap;
+
+ n = rw_file (&rw, filedata, filelen); // filedata now holds the rewritten file, `n` bytes long
+ ```
+ */
+
+#ifndef MIDI_REWRITER_H
+#define MIDI_REWRITER_H
+
+#include "midi-parser.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define RW_DROP_SYSEX 0x1 /* drop 0xF0 and 0xF7 events */
+#define RW_DROP_TEXT 0x2  /* drop text meta events (types 0x01 - 0x0F) */
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    uint32_t flags;             /* RW_DROP_* */
+    const uint8_t *channel_map; /* 16 entries, each 0..15; NULL leaves channels unchanged */
+    /* optional; called for every event not dropped by `flags`; return non-0 to drop the event */
+    int (*drop) (void *user, const track_event_t *e);
+    void *user;
+} midi_rewrite_t;
+
+/* Rewrites event data of a single track from `src` into `dst`;
+ * `dst` may be equal to `src` (in-place rewrite), but must not overlap it otherwise;
+ * Output is never longer than `len`, so `cap` >= `len` is always enough;
+ * On success returns number of bytes written to `dst` (the new track length);
+ * On failure (malformed event, carried delta over 0x0FFFFFFF, `cap` too small, NULL argument) returns -1. `dst`
+ * contents are undefined then. */
+int32_t rw_track (const midi_rewrite_t *rw, const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap);
+
+/* Rewrites every track of a complete MIDI file image in place, and patches track chunk lengths;
+ * Header and non-track chunks are kept as they are, and so are up to 7 trailing bytes too short to be a chunk (some
+ * writers pad files);
+ * On success returns the new length of the file;
+ * On failure (malformed file or event, `len` over 0x7FFFFFFF, NULL argument) returns -1. `file` contents are undefined
+ * then. */
+int32_t rw_file (const midi_rewrite_t *rw, uint8_t *file, uint32_t len);
+
+#ifdef MIDI_REWRITER_IMPLEMENTATION
+
+static int
+_rw_dropped (const midi_rewrite_t *rw, const track_event_t *e)
+{
+    if (e->kind == EV_SYSEX && (rw->flags & RW_DROP_SYSEX)) return 1;
+    if (e->kind == EV_META && (rw->flags & RW_DROP_TEXT) && e->as.meta.type >= 0x01 && e->as.meta.type <= 0x0F)
+        return 1;
+    if (rw->drop && rw->drop (rw->user, e)) return 1;
+    return 0;
+}
+
+int32_t
+rw_track (const midi_rewrite_t *rw, const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+    track_parser_t tp = { 0 };
+    track_event_t ev = { 0 };
+    uint32_t start, span = 0, out = 0, carry = 0, delta, body, body_len;
+    uint8_t head[8], status, out_status = 0;
+    int dn, hn, explicit_status;
+
+    if (rw == NULL || src == NULL || dst == NULL) return -1;
+
+    tp.bytes = src;
+    tp.len = len;
+
+    while (tp.idx < tp.len)
+    {
+        start = tp.idx;
+        if (track_event_next (&tp, &ev) <= 0) return -1;
+        if ((dn = midi_vlq_decode (src + start, len - start, &delta)) <= 0) return -1;
+
+        explicit_status = src[start + dn] & 0x80;
+        status = 0;
+        if (ev.kind == EV_MIDI)
+        {
+            status = ev.as.midi.kind << 4 | ev.as.midi.channel;
+            if (rw->channel_map) status = (status & 0xF0) | (rw->channel_map[status & 0x0F] & 0x0F);
+        }
+
+        if (_rw_dropped (rw, &ev))
+        {
+            /* flush the run before the dropped event, and carry its delta over */
+            if (start - span > cap - out) return -1;
+            memmove (dst + out, src + span, start - span);
+            out += start - span;
+            span = tp.idx;
+
+            if (ev.delta > 0x0FFFFFFF - carry) return -1;
+            carry += ev.delta;
+            continue;
+        }
+
+        if (carry == 0 && (ev.kind != EV_MIDI || (explicit_status ? status == src[start + dn] : status == out_status)))
+        {
+            /* unchanged - stays in the current run */
+            if (ev.kind == EV_MIDI) out_status = status;
+            continue;
+        }
+
+        /* changed - flush the run, then re-encode delta and status, and move the rest of the event */
+        if (start - span > cap - out) return -1;
+        memmove (dst + out, src + span, start - span);
+        out += start - span;
+
+        if (ev.delta > 0x0FFFFFFF - carry) return -1; /* carried delta no longer fits a VLQ */
+        hn = midi_vlq_encode (ev.delta + carry, head);
+        carry = 0;
+        body = start + dn;
+
+        if (ev.kind == EV_MIDI)
+        {
+            if (explicit_status) body += 1;
+            if (explicit_status || status != out_status) head[hn++] = status;
+            out_status = status;
+        }
+
+        body_len = tp.idx - body;
+        if (hn + body_len > cap - out) return -1;
+        if (dst == src && out + hn + body_len > tp.idx) return -1; /* would overwrite unread input */
+
+        memmove (dst + out + hn, src + body, body_len);
+        memcpy (dst + out, head, hn);
+        out += hn + body_len;
+        span = tp.idx;
+    }
+
+    if (len - span > cap - out) return -1;
+    memmove (dst + out, src + span, len - span);
+    out += len - span;
+
+    return out;
+}
+
+static uint32_t
+_rw_get_u32 (const uint8_t *b)
+{
+    return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8 | b[3];
+}
+
+int32_t
+rw_file (const midi_rewrite_t *rw, uint8_t *file, uint32_t len)
+{
+    uint32_t in, out, chunk_len;
+    int32_t n;
+
+    if (rw == NULL || file == NULL) return -1;
+    if (len > 0x7FFFFFFFU) return -1; /* the new length must fit the result */
+    if (len < 14 || _rw_get_u32 (file) != 0x4d546864) return -1;
+
+    if (_rw_get_u32 (file + 4) > len - 8) return -1;
+    in = out = 8 + _rw_get_u32 (file + 4); /* header chunk stays where it is */
+
+    while (len - in >= 8)
+    {
+        chunk_len = _rw_get_u32 (file + in + 4);
+        if (chunk_len > len - in - 8) return -1;
+
+        if (_rw_get_u32 (file + in) == 0x4D54726B)
+        {
+            if ((n = rw_track (rw, file + in + 8, chunk_len, file + in + 8, chunk_len)) < 0) return -1;
+            memmove (file + out, file + in, 8 + n);
+            file[out + 4] = n >> 24;
+            file[out + 5] = n >> 16;
+            file[out + 6] = n >> 8;
+            file[out + 7] = n;
+            out += 8 + n;
+        }
+        else
+        {
+            memmove (file + out, file + in, 8 + chunk_len);
+            out += 8 + chunk_len;
+        }
+
+        in += 8 + chunk_len;
+    }
+
+    memmove (file + out, file + in, len - in); /* trailing bytes */
+    out += len - in;
+
+    return out;
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
@@ -0,0 +1,351 @@
+/* MIDI-splice - assembling MIDI files from tracks of other files, without decoding them
+ * `sp_scan` locates the tracks of a file (its header is parsed by `mr_begin_io`, chunk headers are read with pread,
+ * event data is never read), and `sp_write` writes any list of tracks, from any number of files, as a new file.
+ * Track data is copied as raw bytes: with `copy_file_range` between regular files (so filesystems with reflinks or
+ * server side copy don't move the data at all), with `sendfile` to pipes and sockets, and through a small buffer
+ * otherwise. Tracks that were next to each other in the source file are copied in one go, chunk headers included.
+ * Nothing but the file header and the chunk headers is written by hand; a track can be delayed by a number of ticks,
+ * which rewrites just the delta of its first event (and its length, if the delta grows by a byte or more).
+ * The implementation uses POSIX and Linux APIs - compile it with `_GNU_SOURCE` defined before any system header.
+ * Define `MIDI_SPLICE_NO_ZEROCOPY` to always copy through the buffer.
+
+ * Example usage
+
+ ```c
+ midi_reader_t mra = { 0 }, mrb = { 0 };
+ sp_track_t a[64], b[64], song[2];
+
+ sp_scan (fda, &mra, a, 64);
+ sp_scan (fdb, &mrb, b, 64);
+
+ song[0] = a[0]; // intro from A
+ song[1] = b[3]; // drums from B, entering 4 bars later
+ song[1].delta = 4 * 4 * mra.tickdiv;
+
+ sp_write (out, MIDI_FMT_MTRACK, mra.tickdiv, song, 2);
+ ```
+ */
+
+#ifndef MIDI_SPLICE_H
+#define MIDI_SPLICE_H
+
+#include "midi-io.h"
+#include "midi-parser.h"
+#include "midi-reader.h"
+#include "midi-writer.h"
+
+#include <stdint.h>
+
+/* One track of a source file */
+typedef struct
+{
+    int fd;          /* source file */
+    uint32_t offset; /* file offset of the event data (right past the chunk header) */
+    uint32_t len;    /* length of the event data */
+    uint32_t delta;  /* ticks added to the delta of the first event when written; 0 - copied unchanged */
+} sp_track_t;
+
+/* Parses the header of the MIDI file open at `fd` into `mr` (see `mr_begin_io`), and locates its tracks; chunks other
+ * than tracks are skipped. The first `cap` tracks are stored in `out_tracks`, with `delta` 0; `fd` must be a regular
+ * file, and its file offset is not changed. Only header info (`format`, `ntracks`, `tickdiv`) in `mr` is meaningful
+ * afterwards;
+ * On success returns number of tracks in the file (which may be more than `cap`);
+ * On failure (read error, invalid header, chunk longer than the file, NULL argument) returns -1. */
+int32_t sp_scan (int fd, midi_reader_t *mr, sp_track_t *out_tracks, uint32_t cap);
+
+/* Writes a MIDI file made of `ntracks` tracks to file descriptor `fd`, at its current file offset; `offset` and `len`
+ * of each track must be as filled in by `sp_scan`, and source files must stay open until this function returns.
+ * `fd` may be anything `write` works on - files, pipes, sockets; it is never seeked;
+ * On success returns 0;
+ * On failure (read or write error, source file changed, `ntracks` 0 or over 65535, more than one track in a
+ * MIDI_FMT_SINGLE file, delayed first event beyond the largest delta) returns -1. Part of the file may have been
+ * written. */
+int sp_write (int fd, uint16_t format, uint16_t tickdiv, const sp_track_t *tracks, uint32_t ntracks);
+
+/* Same as `sp_write`, but writes through `io` (only `io->write` is used); all data is copied through a buffer. */
+int sp_write_io (const midi_io_t *io, uint16_t format, uint16_t tickdiv, const sp_track_t *tracks, uint32_t ntracks);
+
+#ifdef MIDI_SPLICE_IMPLEMENTATION
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(MIDI_SPLICE_NO_ZEROCOPY)
+#define MIDI_SPLICE_HAVE_ZEROCOPY
+#include <sys/sendfile.h>
+#endif
+
+#define _SP_BUF 16384 /* buffer used when data can't be copied in the kernel */
+
+/* copy methods, tried in order - each one falls back to the next */
+#define _SP_COPY_RANGE 0
+#define _SP_SENDFILE 1
+#define _SP_BUFFER 2
+
+/* Source of `sp_scan`, read with pread */
+typedef struct
+{
+    int fd;
+    uint32_t off;
+} _sp_src_t;
+
+/* Destination of `sp_write` / `sp_write_io` */
+typedef struct
+{
+    int fd;              /* destination descriptor; -1 if writing through `io` */
+    const midi_io_t *io; /* destination, if `fd` is -1 */
+    int mode;            /* current copy method */
+} _sp_out_t;
+
+static int32_t
+_sp_src_read (void *ctx, uint8_t *buf, uint32_t len)
+{
+    _sp_src_t *src = ctx;
+    ssize_t n = pread (src->fd, buf, len, src->off);
+
+    if (n < 0) return -1;
+    src->off += n;
+    return n;
+}
+
+static int
+_sp_src_size (void *ctx, uint32_t *out_size)
+{
+    struct stat st;
+
+    if (fstat (((_sp_src_t *)ctx)->fd, &st) != 0 || st.st_size > 0xFFFFFFFF) return -1;
+    *out_size = st.st_size;
+    return 0;
+}
+
+static uint32_t
+_sp_u32 (const uint8_t *b)
+{
+    return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8 | b[3];
+}
+
+static void
+_sp_put_u32 (uint8_t *b, uint32_t u32)
+{
+    b[0] = u32 >> 24;
+    b[1] = u32 >> 16;
+    b[2] = u32 >> 8;
+    b[3] = u32;
+}
+
+int32_t
+sp_scan (int fd, midi_reader_t *mr, sp_track_t *out_tracks, uint32_t cap)
+{
+    _sp_src_t src;
+    midi_io_t io;
+    uint8_t h[8];
+    uint32_t off, len;
+    int32_t n = 0;
+
+    if (mr == NULL || (out_tracks == NULL && cap > 0)) return -1;
+
+    src.fd = fd;
+    src.off = 0;
+    io.read = _sp_src_read;
+    io.write = NULL;
+    io.seek = NULL;
+    io.size = _sp_src_size;
+    io.ctx = &src;
+
+    if (mr_begin_io (mr, &io) != 0) return -1;
+
+    for (off = mr->i; off < mr->size; off += 8 + len)
+    {
+        if (mr->size - off < 8 || pread (fd, h, 8, off) != 8) return -1;
+        len = _sp_u32 (h + 4);
+        if (len > mr->size - off - 8) return -1;
+
+        if (memcmp (h, "MTrk", 4) != 0) continue;
+        if (n == 0x7FFFFFFF) return -1;
+        if ((uint32_t)n < cap)
+        {
+            out_tracks[n].fd = fd;
+            out_tracks[n].offset = off + 8;
+            out_tracks[n].len = len;
+            out_tracks[n].delta = 0;
+        }
+        n += 1;
+    }
+
+    return n;
+}
+
+/* Writes all `len` bytes of `buf`; returns 0, or -1 on failure */
+static int
+_sp_write_all (_sp_out_t *o, const uint8_t *buf, uint32_t len)
+{
+    int32_t n;
+
+    while (len > 0)
+    {
+        if (o->fd >= 0)
+        {
+            n = write (o->fd, buf, len);
+            if (n < 0 && errno == EINTR) continue;
+        }
+        else
+            n = o->io->write (o->io->ctx, buf, len);
+        if (n <= 0) return -1;
+
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Copies `len` bytes at `offset` of `fd` to the destination; returns 0, or -1 on failure (including source file
+ * shorter than expected) */
+static int
+_sp_copy (_sp_out_t *o, int fd, uint32_t offset, uint32_t len)
+{
+    uint8_t buf[_SP_BUF];
+    ssize_t n;
+
+    while (len > 0)
+    {
+#ifdef MIDI_SPLICE_HAVE_ZEROCOPY
+        if (o->mode != _SP_BUFFER)
+        {
+            loff_t in_off = offset;
+            off_t file_off = offset;
+
+            if (o->mode == _SP_COPY_RANGE)
+                n = copy_file_range (fd, &in_off, o->fd, NULL, len, 0);
+            else
+                n = sendfile (o->fd, fd, &file_off, len);
+
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                /* not supported between these two files - nothing was copied, so try the next method */
+                if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP && errno != EBADF
+                    && errno != ESPIPE)
+                    return -1;
+                o->mode += 1;
+                continue;
+            }
+        }
+        else
+#endif
+        {
+            n = pread (fd, buf, len < sizeof buf ? len : sizeof buf, offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n > 0 && _sp_write_all (o, buf, n) != 0) return -1;
+        }
+
+        if (n <= 0) return -1;
+        offset += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Writes one chunk header, then event data of `tracks[0]`, and of any following tracks that directly follow it in the
+ * same source file; returns number of tracks written, or -1 on failure */
+static int32_t
+_sp_write_run (_sp_out_t *o, const sp_track_t *tracks, uint32_t ntracks)
+{
+    const sp_track_t *t = tracks;
+    uint8_t h[8 + 4], vlq[4];
+    uint32_t h_len = 8, skip = 0, len = t->len, end, delta;
+    int32_t run = 1;
+    int n;
+
+    memcpy (h, "MTrk", 4);
+
+    if (t->delta > 0 && t->len > 0)
+    {
+        /* rewrite delta of the first event - the rest of the track is copied as is */
+        n = t->len < sizeof vlq ? t->len : sizeof vlq;
+        if (pread (t->fd, vlq, n, t->offset) != n) return -1;
+        if ((n = midi_vlq_decode (vlq, n, &delta)) <= 0) return -1;
+        if (t->delta > 0x0FFFFFFF - delta) return -1;
+
+        skip = n;
+        h_len += midi_vlq_encode (delta + t->delta, h + 8);
+        if (h_len - 8 - skip > 0xFFFFFFFF - len) return -1;
+        len += h_len - 8 - skip;
+    }
+    _sp_put_u32 (h + 4, len);
+    if (_sp_write_all (o, h, h_len) != 0) return -1;
+
+    /* tracks stored back to back are copied with the chunk headers between them */
+    end = t->offset + t->len;
+    while ((uint32_t)run < ntracks && run < 0x7FFFFFFF && t[run].fd == t->fd && t[run].delta == 0
+           && end <= 0xFFFFFFFF - 8 && t[run].offset == end + 8)
+    {
+        end = t[run].offset + t[run].len;
+        run += 1;
+    }
+
+    if (_sp_copy (o, t->fd, t->offset + skip, end - t->offset - skip) != 0) return -1;
+    return run;
+}
+
+static int
+_sp_write (_sp_out_t *o, uint16_t format, uint16_t tickdiv, const sp_track_t *tracks, uint32_t ntracks)
+{
+    uint8_t h[14];
+    uint32_t j;
+    int32_t n;
+
+    if (tracks == NULL || ntracks == 0 || ntracks > 0xFFFF) return -1;
+    if (format == MIDI_FMT_SINGLE && ntracks != 1) return -1;
+
+    memcpy (h, "MThd", 4);
+    _sp_put_u32 (h + 4, 6);
+    h[8] = format >> 8;
+    h[9] = format;
+    h[10] = ntracks >> 8;
+    h[11] = ntracks;
+    h[12] = tickdiv >> 8;
+    h[13] = tickdiv;
+    if (_sp_write_all (o, h, sizeof h) != 0) return -1;
+
+    for (j = 0; j < ntracks; j += n)
+        if ((n = _sp_write_run (o, tracks + j, ntracks - j)) < 0) return -1;
+
+    return 0;
+}
+
+int
+sp_write (int fd, uint16_t format, uint16_t tickdiv, const sp_track_t *tracks, uint32_t ntracks)
+{
+    _sp_out_t o;
+
+    if (fd < 0) return -1;
+
+    o.fd = fd;
+    o.io = NULL;
+    o.mode = _SP_COPY_RANGE;
+
+    return _sp_write (&o, format, tickdiv, tracks, ntracks);
+}
+
+int
+sp_write_io (const midi_io_t *io, uint16_t format, uint16_t tickdiv, const sp_track_t *tracks, uint32_t ntracks)
+{
+    _sp_out_t o;
+
+    if (io == NULL || io->write == NULL) return -1;
+
+    o.fd = -1;
+    o.io = io;
+    o.mode = _SP_BUFFER;
+
+    return _sp_write (&o, format, tickdiv, tracks, ntracks);
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
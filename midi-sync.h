@@ -0,0 +1,369 @@
+/* MIDI-sync - MIDI clock and MIDI time code generation
+ * This header turns the tracks of a MIDI file into the byte stream a sync master sends out: channel and sysex events
+ * of the song, interleaved with MIDI timing clock (0xF8, 24 per quarter note, following the tempo map, between start
+ * 0xFA and stop 0xFC) and MTC quarter frame messages (0xF1, 4 per frame, following wall clock time).
+ * `sy_fill` schedules messages ahead of time, in bulk: each one comes with its time (in nanoseconds from the start of
+ * the song) and its bytes in MIDI wire format, so a real-time thread only has to wait for the time and copy the bytes
+ * (e.g. with `clock_nanosleep (TIMER_ABSTIME)`, like `mp_play` does).
+ * Messages come in time order; sync messages due at the same time as a song event come before it, so that a receiver
+ * sees the beat before the notes on it. Meta events are not sent (but tempo events drive the clock).
+ * Song events are merged and timed with `mp_merge_*` and `mp_tempo_*` from midi-player.h, so that header's
+ * implementation must be compiled in too.
+
+ * Example usage
+
+ ```c
+ midi_sync_t sy = { 0 };
+ sy_msg_t msgs[256];
+ uint8_t bytes[4096];
+ int32_t n, j;
+
+ sy_begin (&sy, tracks, tracklens, ntracks, mr.tickdiv, SY_CLOCK | SY_MTC, SY_MTC_25);
+ while ((n = sy_fill (&sy, msgs, 256, bytes, sizeof bytes)) > 0)
+     for (j = 0; j < n; ++j)
+     {
+         // ... wait until start + msgs[j].ns, write msgs[j].len bytes at msgs[j].data ...
+     }
+ sy_end (&sy);
+ ```
+ */
+
+#ifndef MIDI_SYNC_H
+#define MIDI_SYNC_H
+
+#include "midi-parser.h"
+#include "midi-player.h"
+
+#include <stdint.h>
+
+#define SY_CLOCK 1 /* MIDI timing clock, with start and stop; needs a tickdiv in ticks per quarter note */
+#define SY_MTC 2   /* MTC quarter frames */
+
+/* MTC frame rates, as encoded in quarter frame messages */
+#define SY_MTC_24 0
+#define SY_MTC_25 1
+#define SY_MTC_2997 2 /* 29.97 drop frame */
+#define SY_MTC_30 3
+
+/* System real-time and common messages */
+#define SY_MSG_QUARTER_FRAME 0xF1
+#define SY_MSG_CLOCK 0xF8
+#define SY_MSG_START 0xFA
+#define SY_MSG_STOP 0xFC
+
+#define SY_CLOCKS_PER_QUARTER 24
+
+/* Message of the outgoing stream */
+typedef struct
+{
+    uint64_t ns;         /* time, from the start of the song */
+    const uint8_t *data; /* message in MIDI wire format */
+    uint32_t len;
+} sy_msg_t;
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    uint32_t flags;   /* SY_* */
+    uint8_t mtc_rate; /* SY_MTC_* */
+    /* internal state */
+    mp_merge_t merge;
+    mp_tempo_t tempo;
+    mp_event_t ev;     /* next song event */
+    uint64_t ev_ns;    /* its time */
+    int have_ev;       /* 1 - `ev` is pending */
+    int stage;         /* 0 - nothing sent yet; 1 - song running; 2 - song over */
+    uint32_t clock;    /* index of the next clock */
+    uint64_t clock_ns; /* its time */
+    uint32_t seg;      /* tempo map segment of the next clock */
+    uint32_t qf;       /* index of the next quarter frame */
+    uint64_t qf_ns;    /* its time */
+} midi_sync_t;
+
+/* Prepares generation for `ntracks` tracks (merger and tempo map); Track data is not copied, it must outlive `sy`;
+ * `flags` selects the sync messages (SY_CLOCK, SY_MTC, or both - 0 passes the song through), `mtc_rate` is one of
+ * SY_MTC_*;
+ * On success returns 0;
+ * On failure (malformed event, NULL argument, `tickdiv` is 0 or SMPTE based with SY_CLOCK, out of memory) returns
+ * -1. */
+int sy_begin (midi_sync_t *sy, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks, uint16_t tickdiv,
+              uint32_t flags, uint8_t mtc_rate);
+
+/* Schedules the next messages of the stream: stores up to `cap` of them in `out_msgs`, their bytes in up to
+ * `bytes_cap` bytes of `bytes`; `bytes` must stay untouched while `out_msgs` are in use;
+ * On success returns number of messages stored, 0 at the end of the stream;
+ * On failure (malformed event, sysex event longer than `bytes_cap`, `cap` or `bytes_cap` too small to hold a single
+ * message, NULL argument) returns -1. */
+int32_t sy_fill (midi_sync_t *sy, sy_msg_t *out_msgs, uint32_t cap, uint8_t *bytes, uint32_t bytes_cap);
+
+/* Releases memory held by the generator. */
+void sy_end (midi_sync_t *sy);
+
+#ifdef MIDI_SYNC_IMPLEMENTATION
+
+#include <string.h>
+
+/* Time of clock `sy->clock` - quarter note `clock / 24`, which may fall between two ticks; moves `sy->seg` along */
+static uint64_t
+_sy_clock_ns (midi_sync_t *sy)
+{
+    const mp_tempo_t *t = &sy->tempo;
+    uint64_t pos = (uint64_t)sy->clock * t->tickdiv, div = (uint64_t)SY_CLOCKS_PER_QUARTER * t->tickdiv, dt;
+    const mp_tempo_seg_t *s;
+
+    /* positions are in 1/24 ticks */
+    while (sy->seg + 1 < t->nsegs && (uint64_t)t->segs[sy->seg + 1].tick * SY_CLOCKS_PER_QUARTER <= pos) sy->seg += 1;
+
+    s = &t->segs[sy->seg];
+    dt = pos - (uint64_t)s->tick * SY_CLOCKS_PER_QUARTER;
+    return s->ns + dt / div * s->tempo * 1000 + dt % div * s->tempo * 1000 / div;
+}
+
+/* Time of quarter frame `sy->qf` */
+static uint64_t
+_sy_qf_ns (const midi_sync_t *sy)
+{
+    static const uint32_t fps[4] = { 24, 25, 30, 30 };
+
+    if (sy->mtc_rate == SY_MTC_2997) return (uint64_t)sy->qf * 1001000000 / (4 * 30);
+    return (uint64_t)sy->qf * 1000000000 / (4 * fps[sy->mtc_rate]);
+}
+
+/* Writes quarter frame `sy->qf` into `out` (2 bytes) - piece `qf % 8` of the time code of frame `qf / 4` rounded down
+ * to an even frame, as every 8 quarter frames describe the frame the first of them was sent at */
+static void
+_sy_qf_bytes (const midi_sync_t *sy, uint8_t *out)
+{
+    static const uint32_t fps[4] = { 24, 25, 30, 30 };
+    uint32_t piece = sy->qf % 8, frame = sy->qf / 8 * 2, r = fps[sy->mtc_rate], d, m, v;
+    uint32_t ff, ss, mm, hh;
+
+    if (sy->mtc_rate == SY_MTC_2997)
+    {
+        /* drop frame - labels 0 and 1 are skipped every minute, except every tenth one */
+        d = frame / 17982;
+        m = frame % 17982;
+        frame += 18 * d + (m > 1 ? 2 * ((m - 2) / 1798) : 0);
+    }
+
+    ff = frame % r;
+    ss = frame / r % 60;
+    mm = frame / r / 60 % 60;
+    hh = frame / r / 3600 % 24;
+
+    switch (piece)
+    {
+    case 0: v = ff & 0x0F; break;
+    case 1: v = ff >> 4; break;
+    case 2: v = ss & 0x0F; break;
+    case 3: v = ss >> 4; break;
+    case 4: v = mm & 0x0F; break;
+    case 5: v = mm >> 4; break;
+    case 6: v = hh & 0x0F; break;
+    default: v = hh >> 4 | (uint32_t)sy->mtc_rate << 1; break;
+    }
+
+    out[0] = SY_MSG_QUARTER_FRAME;
+    out[1] = piece << 4 | v;
+}
+
+/* Reads the next song event into `sy->ev`; returns 1, 0 at the end of the song (leaving the last event in place), or
+ * -1 */
+static int
+_sy_next_event (midi_sync_t *sy)
+{
+    int n;
+
+    if ((n = mp_merge_next (&sy->merge, &sy->ev)) <= 0) return n;
+    sy->ev_ns = mp_tick_to_ns (&sy->tempo, sy->ev.tick);
+    return 1;
+}
+
+/* Finds wire format of a song event - `*head_len` (0 or 1) status bytes stored in `head`, followed by the returned
+ * number of bytes at `*body`, taken from the source track as they are; meta events have neither */
+static uint32_t
+_sy_wire (const mp_event_t *e, uint8_t *head, uint32_t *head_len, const uint8_t **body)
+{
+    uint32_t len;
+    int n;
+
+    *head_len = 0;
+    if (e->ev.kind == EV_MIDI)
+    {
+        len = e->ev.as.midi.kind == MIDI_PROGRAM || e->ev.as.midi.kind == MIDI_CHAN_PRESSURE ? 1 : 2;
+        if (len > e->raw_len) return 0;
+
+        head[0] = e->ev.as.midi.kind << 4 | e->ev.as.midi.channel;
+        *head_len = 1;
+        *body = e->raw + e->raw_len - len;
+        return len;
+    }
+    if (e->ev.kind != EV_SYSEX) return 0;
+
+    /* whole payload, terminating 0xF7 included; 0xF7 escapes (sysex continuations, real-time messages) are sent
+     * without their status */
+    if ((n = midi_vlq_decode (e->raw + 1, e->raw_len - 1, &len)) <= 0) return 0;
+    if (e->raw[0] == 0xF0)
+    {
+        head[0] = 0xF0;
+        *head_len = 1;
+    }
+    *body = e->raw + 1 + n;
+    return e->raw_len - 1 - n;
+}
+
+/* Stores a message made of `head_len` bytes of `head` and `body_len` bytes of `body` in `msg`, and its bytes at
+ * `bytes` + `*used`; returns 0, or -1 if `bytes` is full */
+static int
+_sy_push (sy_msg_t *msg, uint8_t *bytes, uint32_t *used, uint32_t bytes_cap, uint64_t ns, const uint8_t *head,
+          uint32_t head_len, const uint8_t *body, uint32_t body_len)
+{
+    if (head_len + body_len > bytes_cap - *used) return -1;
+
+    memcpy (bytes + *used, head, head_len);
+    if (body_len) memcpy (bytes + *used + head_len, body, body_len);
+
+    msg->ns = ns;
+    msg->data = bytes + *used;
+    msg->len = head_len + body_len;
+    *used += msg->len;
+    return 0;
+}
+
+int
+sy_begin (midi_sync_t *sy, const uint8_t *const *tracks, const uint32_t *lens, uint32_t ntracks, uint16_t tickdiv,
+          uint32_t flags, uint8_t mtc_rate)
+{
+    int n;
+
+    if (sy == NULL || mtc_rate > SY_MTC_30) return -1;
+    if ((flags & SY_CLOCK) && (tickdiv & 0x8000)) return -1; /* no quarter notes to count */
+
+    memset (sy, 0, sizeof *sy);
+    sy->flags = flags;
+    sy->mtc_rate = mtc_rate;
+
+    if (mp_tempo_begin (&sy->tempo, tickdiv) != 0) return -1;
+    if (mp_tempo_scan (&sy->tempo, tracks, lens, ntracks) != 0
+        || mp_merge_begin (&sy->merge, tracks, lens, ntracks) != 0)
+    {
+        mp_tempo_end (&sy->tempo);
+        return -1;
+    }
+    if ((n = _sy_next_event (sy)) < 0)
+    {
+        sy_end (sy);
+        return -1;
+    }
+
+    sy->have_ev = n;
+    if (flags & SY_CLOCK) sy->clock_ns = _sy_clock_ns (sy);
+
+    return 0;
+}
+
+int32_t
+sy_fill (midi_sync_t *sy, sy_msg_t *out_msgs, uint32_t cap, uint8_t *bytes, uint32_t bytes_cap)
+{
+    uint32_t n = 0, used = 0, len, head_len;
+    const uint8_t *body;
+    uint64_t ns = 0;
+    uint8_t b[2];
+    int r;
+
+    if (sy == NULL || out_msgs == NULL || bytes == NULL) return -1;
+    if (cap == 0 && sy->stage != 2) return -1; /* 0 would read as the end of the stream */
+
+    while (n < cap && sy->stage != 2)
+    {
+        if (sy->stage == 0)
+        {
+            b[0] = SY_MSG_START;
+            if ((sy->flags & SY_CLOCK) && _sy_push (&out_msgs[n++], bytes, &used, bytes_cap, 0, b, 1, NULL, 0) != 0)
+                return -1; /* empty buffer - `bytes_cap` is 0 */
+            sy->stage = 1;
+            continue;
+        }
+
+        /* sync messages due no later than the next song event - or the last one, once the song is over */
+        len = 0;
+        if ((sy->flags & SY_CLOCK) && sy->clock_ns <= sy->ev_ns)
+        {
+            ns = sy->clock_ns;
+            b[0] = SY_MSG_CLOCK;
+            len = 1;
+        }
+        if ((sy->flags & SY_MTC) && sy->qf_ns <= sy->ev_ns && (len == 0 || sy->qf_ns < ns))
+        {
+            ns = sy->qf_ns;
+            _sy_qf_bytes (sy, b);
+            len = 2;
+        }
+
+        if (len > 0)
+        {
+            if (_sy_push (&out_msgs[n], bytes, &used, bytes_cap, ns, b, len, NULL, 0) != 0)
+            {
+                if (n == 0) return -1; /* doesn't fit even in an empty buffer */
+                break;
+            }
+            n += 1;
+
+            if (len == 1)
+            {
+                sy->clock += 1;
+                sy->clock_ns = _sy_clock_ns (sy);
+            }
+            else
+            {
+                sy->qf += 1;
+                sy->qf_ns = _sy_qf_ns (sy);
+            }
+            continue;
+        }
+
+        if (!sy->have_ev)
+        {
+            b[0] = SY_MSG_STOP;
+            if ((sy->flags & SY_CLOCK)
+                && _sy_push (&out_msgs[n], bytes, &used, bytes_cap, sy->ev_ns, b, 1, NULL, 0) != 0)
+            {
+                if (n == 0) return -1; /* doesn't fit even in an empty buffer */
+                break;
+            }
+            n += (sy->flags & SY_CLOCK) ? 1 : 0;
+            sy->stage = 2;
+            continue;
+        }
+
+        len = _sy_wire (&sy->ev, b, &head_len, &body);
+        if (head_len + len > 0)
+        {
+            if (_sy_push (&out_msgs[n], bytes, &used, bytes_cap, sy->ev_ns, b, head_len, body, len) != 0)
+            {
+                if (n == 0) return -1; /* doesn't fit even in an empty buffer */
+                break;
+            }
+            n += 1;
+        }
+
+        if ((r = _sy_next_event (sy)) < 0) return -1;
+        sy->have_ev = r;
+    }
+
+    return n;
+}
+
+void
+sy_end (midi_sync_t *sy)
+{
+    if (sy == NULL) return;
+
+    mp_merge_end (&sy->merge);
+    mp_tempo_end (&sy->tempo);
+    memset (sy, 0, sizeof *sy);
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
@@ -0,0 +1,736 @@
+/* MIDI-transform - bulk edits over columnar MIDI event batches
+ * This header decodes a track once into a `midi_batch_t` (one array per event field), runs bulk edit kernels over the
+ * arrays (transpose, channel remap, velocity curve, quantize, time scaling), and encodes the batch back into SMF event
+ * data, with running status, either into a buffer or straight through `midi-writer.h`.
+ * Kernels use AVX2 when the compiler targets it (`-mavx2`), and plain loops otherwise. Define
+ * `MIDI_TRANSFORM_NO_SIMD` to force the plain loops.
+ * Meta and sysex payloads are not copied - they point into the track data the batch was loaded from, so that data must
+ * outlive the batch.
+
+ * Example usage
+
+ ```c
+ midi_batch_t mb = { 0 };
+ uint8_t curve[128];
+
+ mb_load_track (&mb, evdata, tracklen);
+ mb_transpose (&mb, +2, MIDI_BATCH_ALL_CHANNELS & ~(1 << 9));
+ mb_velocity_curve (&mb, curve, MIDI_BATCH_ALL_CHANNELS);
+ mb_quantize (&mb, tickdiv / 4, 256, MIDI_BATCH_ALL_CHANNELS);
+ mb_sort (&mb);
+
+ mw_track_begin (&mw);
+ mb_write_track (&mb, &mw);
+ mw_track_end (&mw);
+
+ mb_free (&mb);
+ ```
+ */
+
+#ifndef MIDI_TRANSFORM_H
+#define MIDI_TRANSFORM_H
+
+#include "midi-parser.h"
+#include "midi-writer.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIDI_BATCH_ALL_CHANNELS 0xFFFF
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    uint32_t *tick;          /* absolute tick of the event */
+    uint8_t *status;         /* status byte (running status resolved); 0xFF for meta, 0xF0 / 0xF7 for sysex */
+    uint8_t *data1;          /* first data byte; meta type for meta events */
+    uint8_t *data2;          /* second data byte; 0 if the event has only one */
+    const uint8_t **payload; /* meta / sysex payload (points into source track data); unused for MIDI events */
+    uint32_t *length;        /* meta / sysex payload length, as stored in the file; unused for MIDI events */
+    uint32_t count;          /* number of events in batch */
+    uint32_t capacity;       /* number of events the arrays can hold */
+} midi_batch_t;
+
+/* Decodes all events of a track, and appends them to the batch;
+ * Ticks continue from the last event already in the batch, so calling this for several tracks concatenates them.
+ * On success returns number of events appended;
+ * On failure (allocation failed, malformed event) returns -1. Events decoded before the failure are kept. */
+int mb_load_track (midi_batch_t *mb, const uint8_t *bytes, uint32_t len);
+
+/* Frees arrays owned by the batch, and zeroes it out. */
+void mb_free (midi_batch_t *mb);
+
+/* Shifts note numbers of note on / off and poly pressure events on channels in `chanmask` (bit N = channel N);
+ * Results are clamped to 0..127. */
+void mb_transpose (midi_batch_t *mb, int semitones, uint16_t chanmask);
+
+/* Replaces the channel of every channel message with `map[channel]`; Entries must be 0..15. */
+void mb_remap_channels (midi_batch_t *mb, const uint8_t map[16]);
+
+/* Replaces velocity of note on events on channels in `chanmask` with `lut[velocity]`;
+ * Note on events with velocity 0 (note offs) are left alone, and the curve never turns a note on into one. */
+void mb_velocity_curve (midi_batch_t *mb, const uint8_t lut[128], uint16_t chanmask);
+
+/* Moves note on / off events on channels in `chanmask` towards the nearest multiple of `grid` ticks;
+ * `strength` is 8.8 fixed-point (256 moves events all the way onto the grid, 128 halfway, 0 not at all);
+ * `grid` must be less than 2^23. Quantizing can break tick ordering - call `mb_sort` before encoding. */
+void mb_quantize (midi_batch_t *mb, uint32_t grid, uint32_t strength, uint16_t chanmask);
+
+/* Multiplies every tick by `ratio`, in 16.16 fixed-point (0x10000 leaves timing unchanged, 0x8000 plays twice as
+ * fast). Absolute ticks are scaled, so rounding never accumulates across deltas. */
+void mb_scale_time (midi_batch_t *mb, uint32_t ratio);
+
+/* Stable-sorts the batch by tick (merge sort, O(n log n)); Runs that are in order already are copied, not merged, so
+ * nearly sorted batches (e.g. after `mb_quantize`) are cheap; Sorted batches return without allocating;
+ * On success returns 0;
+ * On failure (NULL argument, out of memory) returns -1. The batch is unchanged then. */
+int mb_sort (midi_batch_t *mb);
+
+/* Returns number of bytes `mb_encode` will produce for the batch; 0 if the batch isn't sorted by tick. */
+uint32_t mb_get_storage_size (const midi_batch_t *mb);
+
+/* Encodes the batch into SMF event data, using running status; The batch must be sorted by tick (see `mb_sort`);
+ * End of track events are moved to the end of the track. If the batch has none, none is written.
+ * On success returns number of bytes written;
+ * On failure (ticks not sorted, `cap` too small, NULL argument) returns -1. */
+int32_t mb_encode (const midi_batch_t *mb, uint8_t *out_bytes, uint32_t cap);
+
+/* Encodes the batch like `mb_encode`, and appends the result to the current track of `mw`;
+ * This function does not begin or end the track - call `mw_track_begin` and `mw_track_end` around it;
+ * On success returns 0;
+ * On failure (ticks not sorted, write failed, NULL argument) returns -1. */
+int mb_write_track (const midi_batch_t *mb, midi_writer_t *mw);
+
+#ifdef MIDI_TRANSFORM_IMPLEMENTATION
+
+#if defined(__AVX2__) && !defined(MIDI_TRANSFORM_NO_SIMD)
+#define MIDI_TRANSFORM_AVX2
+#include <immintrin.h>
+#endif
+
+static int
+_mb_reserve (midi_batch_t *mb, uint32_t capacity)
+{
+    uint32_t n;
+    void *p;
+
+    if (capacity <= mb->capacity) return 0;
+
+    n = mb->capacity ? mb->capacity : 256;
+    while (n < capacity) n *= 2;
+
+    if ((p = realloc (mb->tick, n * sizeof *mb->tick)) == NULL) return -1;
+    mb->tick = p;
+    if ((p = realloc (mb->status, n)) == NULL) return -1;
+    mb->status = p;
+    if ((p = realloc (mb->data1, n)) == NULL) return -1;
+    mb->data1 = p;
+    if ((p = realloc (mb->data2, n)) == NULL) return -1;
+    mb->data2 = p;
+    if ((p = realloc ((void *)mb->payload, n * sizeof *mb->payload)) == NULL) return -1;
+    mb->payload = p;
+    if ((p = realloc (mb->length, n * sizeof *mb->length)) == NULL) return -1;
+    mb->length = p;
+
+    mb->capacity = n;
+    return 0;
+}
+
+int
+mb_load_track (midi_batch_t *mb, const uint8_t *bytes, uint32_t len)
+{
+    track_parser_t tp = { 0 };
+    track_event_t ev = { 0 };
+    const uint8_t *p;
+    uint32_t tick, i, start;
+    int32_t n;
+    uint8_t st;
+    int appended = 0;
+
+    if (mb == NULL || bytes == NULL) return -1;
+
+    tp.bytes = bytes;
+    tp.len = len;
+    tick = mb->count ? mb->tick[mb->count - 1] : 0;
+
+    /* shortest event is 2 bytes (delta + running status data byte), so this is room for every event of the track */
+    if (_mb_reserve (mb, mb->count + len / 2 + 1) != 0) return -1;
+
+    while (tp.idx < tp.len)
+    {
+        i = mb->count;
+        p = bytes + tp.idx;
+
+        /* fast path for the bulk of a track: one byte delta, then a channel message */
+        if (p[0] < 0x80 && tp.len - tp.idx >= 4)
+        {
+            st = p[1] & 0x80 ? p[1] : tp.last_status;
+            if (st >= 0x80 && st < 0xF0)
+            {
+                p += p[1] & 0x80 ? 2 : 1;
+                tick += bytes[tp.idx];
+                mb->tick[i] = tick;
+                mb->status[i] = st;
+                mb->data1[i] = p[0];
+                if ((st >> 4) == MIDI_PROGRAM || (st >> 4) == MIDI_CHAN_PRESSURE)
+                {
+                    mb->data2[i] = 0;
+                    p += 1;
+                }
+                else
+                {
+                    mb->data2[i] = p[1];
+                    p += 2;
+                }
+
+                tp.idx = p - bytes;
+                tp.last_status = st;
+                mb->count += 1;
+                appended += 1;
+                continue;
+            }
+        }
+
+        if ((n = track_event_next (&tp, &ev)) <= 0) return -1;
+
+        start = tp.idx - n;
+        tick += ev.delta;
+
+        mb->tick[i] = tick;
+        mb->data2[i] = 0;
+        mb->payload[i] = NULL;
+        mb->length[i] = 0;
+
+        switch (ev.kind)
+        {
+        case EV_MIDI:
+            mb->status[i] = ev.as.midi.kind << 4 | ev.as.midi.channel;
+            if (bytes[start] & 0x80) start += 1; /* explicit status */
+            mb->data1[i] = bytes[start];
+            if (ev.as.midi.kind != MIDI_PROGRAM && ev.as.midi.kind != MIDI_CHAN_PRESSURE)
+                mb->data2[i] = bytes[start + 1];
+            break;
+        case EV_META:
+            mb->status[i] = 0xFF;
+            mb->data1[i] = ev.as.meta.type;
+            mb->payload[i] = ev.as.meta.data;
+            mb->length[i] = ev.as.meta.length;
+            break;
+        case EV_SYSEX:
+            mb->status[i] = bytes[start];
+            mb->data1[i] = 0;
+            mb->payload[i] = ev.as.sysex.data;
+            /* the parser drops the last payload byte from `length`, and reports 0 for both 0 and 1 byte payloads, so
+             * take the stored length from the bytes the event spans */
+            mb->length[i] = tp.idx - (uint32_t)(ev.as.sysex.data - bytes);
+            break;
+        }
+
+        mb->count += 1;
+        appended += 1;
+    }
+
+    return appended;
+}
+
+void
+mb_free (midi_batch_t *mb)
+{
+    if (mb == NULL) return;
+
+    free (mb->tick);
+    free (mb->status);
+    free (mb->data1);
+    free (mb->data2);
+    free ((void *)mb->payload);
+    free (mb->length);
+    memset (mb, 0, sizeof *mb);
+}
+
+#ifdef MIDI_TRANSFORM_AVX2
+
+/* 0xFF in every byte lane, whose status is a channel message on a channel in `chantab` */
+static __m256i
+_mb_chan_select (__m256i status, __m256i chantab)
+{
+    return _mm256_shuffle_epi8 (chantab, _mm256_and_si256 (status, _mm256_set1_epi8 (0x0F)));
+}
+
+static __m256i
+_mb_kind (__m256i status)
+{
+    return _mm256_and_si256 (_mm256_srli_epi16 (status, 4), _mm256_set1_epi8 (0x0F));
+}
+
+static __m256i
+_mb_chantab (uint16_t chanmask)
+{
+    uint8_t tab[16];
+    int c;
+
+    for (c = 0; c < 16; ++c) tab[c] = (chanmask >> c) & 1 ? 0xFF : 0x00;
+    return _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i *)tab));
+}
+
+#endif
+
+void
+mb_transpose (midi_batch_t *mb, int semitones, uint16_t chanmask)
+{
+    uint32_t i = 0;
+    uint8_t kind;
+    int note;
+
+    if (mb == NULL || semitones == 0) return;
+    if (semitones > 127) semitones = 127;
+    if (semitones < -127) semitones = -127;
+
+#ifdef MIDI_TRANSFORM_AVX2
+    {
+        const __m256i chantab = _mb_chantab (chanmask);
+        const __m256i shift = _mm256_set1_epi8 ((char)semitones);
+        const __m256i zero = _mm256_setzero_si256 ();
+
+        for (; i + 32 <= mb->count; i += 32)
+        {
+            __m256i st = _mm256_loadu_si256 ((const __m256i *)(mb->status + i));
+            __m256i d1 = _mm256_loadu_si256 ((const __m256i *)(mb->data1 + i));
+            __m256i kind8 = _mb_kind (st);
+            __m256i sel
+                = _mm256_or_si256 (_mm256_or_si256 (_mm256_cmpeq_epi8 (kind8, _mm256_set1_epi8 (MIDI_NOTE_OFF)),
+                                                    _mm256_cmpeq_epi8 (kind8, _mm256_set1_epi8 (MIDI_NOTE_ON))),
+                                   _mm256_cmpeq_epi8 (kind8, _mm256_set1_epi8 (MIDI_POLY_PRESSURE)));
+            __m256i moved = _mm256_max_epi8 (_mm256_adds_epi8 (d1, shift), zero);
+
+            sel = _mm256_and_si256 (sel, _mb_chan_select (st, chantab));
+            _mm256_storeu_si256 ((__m256i *)(mb->data1 + i), _mm256_blendv_epi8 (d1, moved, sel));
+        }
+    }
+#endif
+
+    for (; i < mb->count; ++i)
+    {
+        kind = mb->status[i] >> 4;
+        if (kind != MIDI_NOTE_OFF && kind != MIDI_NOTE_ON && kind != MIDI_POLY_PRESSURE) continue;
+        if (!((chanmask >> (mb->status[i] & 0x0F)) & 1)) continue;
+
+        note = mb->data1[i] + semitones;
+        mb->data1[i] = note < 0 ? 0 : note > 127 ? 127 : note;
+    }
+}
+
+void
+mb_remap_channels (midi_batch_t *mb, const uint8_t map[16])
+{
+    uint32_t i = 0;
+    uint8_t st;
+
+    if (mb == NULL || map == NULL) return;
+
+#ifdef MIDI_TRANSFORM_AVX2
+    {
+        const __m256i tab = _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i *)map));
+        const __m256i lonib = _mm256_set1_epi8 (0x0F);
+
+        for (; i + 32 <= mb->count; i += 32)
+        {
+            __m256i s = _mm256_loadu_si256 ((const __m256i *)(mb->status + i));
+            __m256i kind8 = _mb_kind (s);
+            __m256i sel = _mm256_andnot_si256 (_mm256_cmpeq_epi8 (kind8, lonib),
+                                               _mm256_cmpgt_epi8 (kind8, _mm256_set1_epi8 (7)));
+            __m256i chan = _mm256_and_si256 (_mm256_shuffle_epi8 (tab, _mm256_and_si256 (s, lonib)), lonib);
+            __m256i remapped = _mm256_or_si256 (_mm256_andnot_si256 (lonib, s), chan);
+
+            _mm256_storeu_si256 ((__m256i *)(mb->status + i), _mm256_blendv_epi8 (s, remapped, sel));
+        }
+    }
+#endif
+
+    for (; i < mb->count; ++i)
+    {
+        st = mb->status[i];
+        if (st < 0x80 || st >= 0xF0) continue;
+        mb->status[i] = (st & 0xF0) | (map[st & 0x0F] & 0x0F);
+    }
+}
+
+void
+mb_velocity_curve (midi_batch_t *mb, const uint8_t lut[128], uint16_t chanmask)
+{
+    uint32_t i = 0;
+    uint8_t v;
+
+    if (mb == NULL || lut == NULL) return;
+
+#ifdef MIDI_TRANSFORM_AVX2
+    {
+        const __m256i chantab = _mb_chantab (chanmask);
+        const __m256i zero = _mm256_setzero_si256 ();
+        const __m256i one = _mm256_set1_epi8 (1);
+        __m256i tabs[8];
+        int k;
+
+        for (k = 0; k < 8; ++k)
+            tabs[k] = _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i *)(lut + 16 * k)));
+
+        for (; i + 32 <= mb->count; i += 32)
+        {
+            __m256i st = _mm256_loadu_si256 ((const __m256i *)(mb->status + i));
+            __m256i d2 = _mm256_loadu_si256 ((const __m256i *)(mb->data2 + i));
+            __m256i hi = _mm256_and_si256 (_mm256_srli_epi16 (d2, 4), _mm256_set1_epi8 (0x07));
+            __m256i curved = zero;
+            __m256i sel;
+
+            /* 128-entry lookup as eight 16-entry shuffles, picked by the high 3 bits of velocity */
+            for (k = 0; k < 8; ++k)
+                curved = _mm256_blendv_epi8 (curved, _mm256_shuffle_epi8 (tabs[k], d2),
+                                             _mm256_cmpeq_epi8 (hi, _mm256_set1_epi8 ((char)k)));
+            curved = _mm256_max_epu8 (_mm256_and_si256 (curved, _mm256_set1_epi8 (0x7F)), one);
+
+            sel = _mm256_cmpeq_epi8 (_mb_kind (st), _mm256_set1_epi8 (MIDI_NOTE_ON));
+            sel = _mm256_andnot_si256 (_mm256_cmpeq_epi8 (d2, zero), sel);
+            sel = _mm256_and_si256 (sel, _mb_chan_select (st, chantab));
+            _mm256_storeu_si256 ((__m256i *)(mb->data2 + i), _mm256_blendv_epi8 (d2, curved, sel));
+        }
+    }
+#endif
+
+    for (; i < mb->count; ++i)
+    {
+        if (mb->status[i] >> 4 != MIDI_NOTE_ON) continue;
+        if (!((chanmask >> (mb->status[i] & 0x0F)) & 1)) continue;
+        if ((v = mb->data2[i]) == 0) continue;
+
+        v = lut[v & 0x7F] & 0x7F;
+        mb->data2[i] = v ? v : 1;
+    }
+}
+
+void
+mb_quantize (midi_batch_t *mb, uint32_t grid, uint32_t strength, uint16_t chanmask)
+{
+    uint32_t i = 0, inv, half, q, m, kind;
+    int32_t diff, adj;
+
+    if (mb == NULL || grid < 2 || grid >= (1U << 23)) return;
+    if (strength > 256) strength = 256;
+
+    /* x / grid is computed as (x * inv) >> 32, which is either exact or one too small */
+    inv = (uint32_t)(((uint64_t)1 << 32) / grid);
+    half = grid / 2;
+
+#ifdef MIDI_TRANSFORM_AVX2
+    {
+        const __m256i vinv = _mm256_set1_epi32 ((int)inv);
+        const __m256i vgrid = _mm256_set1_epi32 ((int)grid);
+        const __m256i vhalf = _mm256_set1_epi32 ((int)half);
+        const __m256i vstr = _mm256_set1_epi32 ((int)strength);
+        const __m256i sign = _mm256_set1_epi32 ((int)0x80000000U);
+        const __m256i glim = _mm256_xor_si256 (_mm256_set1_epi32 ((int)(grid - 1)), sign);
+        const __m256i vmask = _mm256_set1_epi32 (chanmask);
+        const __m256i one = _mm256_set1_epi32 (1);
+
+        for (; i + 8 <= mb->count; i += 8)
+        {
+            __m256i t = _mm256_loadu_si256 ((const __m256i *)(mb->tick + i));
+            __m256i st = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(mb->status + i)));
+            __m256i kind8 = _mm256_srli_epi32 (st, 4);
+            __m256i x = _mm256_add_epi32 (t, vhalf);
+            __m256i qe = _mm256_srli_epi64 (_mm256_mul_epu32 (x, vinv), 32);
+            __m256i qo = _mm256_mul_epu32 (_mm256_srli_epi64 (x, 32), vinv);
+            __m256i vq = _mm256_blend_epi32 (qe, qo, 0xAA);
+            __m256i vm = _mm256_mullo_epi32 (vq, vgrid);
+            __m256i r = _mm256_sub_epi32 (x, vm);
+            __m256i fix = _mm256_cmpgt_epi32 (_mm256_xor_si256 (r, sign), glim);
+            __m256i vdiff, vadj, sel, chan;
+
+            vm = _mm256_add_epi32 (vm, _mm256_and_si256 (fix, vgrid));
+            vdiff = _mm256_sub_epi32 (vm, t);
+            vadj = _mm256_srai_epi32 (_mm256_mullo_epi32 (vdiff, vstr), 8);
+
+            sel = _mm256_or_si256 (_mm256_cmpeq_epi32 (kind8, _mm256_set1_epi32 (MIDI_NOTE_ON)),
+                                   _mm256_cmpeq_epi32 (kind8, _mm256_set1_epi32 (MIDI_NOTE_OFF)));
+            chan = _mm256_srlv_epi32 (vmask, _mm256_and_si256 (st, _mm256_set1_epi32 (0x0F)));
+            sel = _mm256_and_si256 (sel, _mm256_cmpeq_epi32 (_mm256_and_si256 (chan, one), one));
+
+            _mm256_storeu_si256 ((__m256i *)(mb->tick + i), _mm256_add_epi32 (t, _mm256_and_si256 (vadj, sel)));
+        }
+    }
+#endif
+
+    for (; i < mb->count; ++i)
+    {
+        kind = mb->status[i] >> 4;
+        if (kind != MIDI_NOTE_ON && kind != MIDI_NOTE_OFF) continue;
+        if (!((chanmask >> (mb->status[i] & 0x0F)) & 1)) continue;
+
+        q = (uint32_t)(((uint64_t)(mb->tick[i] + half) * inv) >> 32);
+        m = q * grid;
+        if (mb->tick[i] + half - m >= grid) m += grid;
+
+        /* floor (diff * strength / 256), same rounding as the arithmetic shift in the vector path */
+        diff = (int32_t)(m - mb->tick[i]);
+        if (diff >= 0)
+            adj = (diff * (int32_t)strength) >> 8;
+        else
+            adj = -(int32_t)((((uint32_t)-diff * strength) + 255) >> 8);
+        mb->tick[i] += adj;
+    }
+}
+
+void
+mb_scale_time (midi_batch_t *mb, uint32_t ratio)
+{
+    uint32_t i = 0;
+
+    if (mb == NULL || ratio == 0x10000) return;
+
+#ifdef MIDI_TRANSFORM_AVX2
+    {
+        const __m256i vr = _mm256_set1_epi32 ((int)ratio);
+        const __m256i round = _mm256_set1_epi64x (0x8000);
+
+        for (; i + 8 <= mb->count; i += 8)
+        {
+            __m256i t = _mm256_loadu_si256 ((const __m256i *)(mb->tick + i));
+            __m256i pe = _mm256_add_epi64 (_mm256_mul_epu32 (t, vr), round);
+            __m256i po = _mm256_add_epi64 (_mm256_mul_epu32 (_mm256_srli_epi64 (t, 32), vr), round);
+
+            pe = _mm256_srli_epi64 (pe, 16);
+            po = _mm256_slli_epi64 (_mm256_srli_epi64 (po, 16), 32);
+            _mm256_storeu_si256 ((__m256i *)(mb->tick + i), _mm256_blend_epi32 (pe, po, 0xAA));
+        }
+    }
+#endif
+
+    for (; i < mb->count; ++i) mb->tick[i] = (uint32_t)(((uint64_t)mb->tick[i] * ratio + 0x8000) >> 16);
+}
+
+int
+mb_sort (midi_batch_t *mb)
+{
+    uint32_t *perm, *work, *src, *dst, *t, n, width, lo, mid, hi, i, j, k;
+    void *tmp;
+
+    if (mb == NULL) return -1;
+
+    n = mb->count;
+    for (i = 1; i < n && mb->tick[i - 1] <= mb->tick[i]; ++i);
+    if (i >= n) return 0; /* already sorted */
+
+    perm = malloc (n * sizeof *perm);
+    work = malloc (n * sizeof *work);
+    tmp = malloc (n * sizeof *mb->payload); /* widest column */
+    if (perm == NULL || work == NULL || tmp == NULL)
+    {
+        free (perm);
+        free (work);
+        free (tmp);
+        return -1;
+    }
+
+    /* bottom-up merge sort of event indices by tick; ties take the left run first, which keeps it stable */
+    for (i = 0; i < n; ++i) perm[i] = i;
+    src = perm;
+    dst = work;
+    for (width = 1; width < n; width = width > n / 2 ? n : width * 2)
+    {
+        for (lo = 0; lo < n; lo = hi)
+        {
+            mid = n - lo > width ? lo + width : n;
+            hi = n - mid > width ? mid + width : n;
+
+            if (mid == hi || mb->tick[src[mid - 1]] <= mb->tick[src[mid]])
+            {
+                /* runs are in order already - common after `mb_quantize` */
+                memcpy (dst + lo, src + lo, (hi - lo) * sizeof *dst);
+                continue;
+            }
+
+            for (i = lo, j = mid, k = lo; i < mid && j < hi;)
+                dst[k++] = mb->tick[src[j]] < mb->tick[src[i]] ? src[j++] : src[i++];
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+
+        t = src;
+        src = dst;
+        dst = t;
+    }
+
+    /* gather each column in sorted order */
+    for (i = 0; i < n; ++i) ((uint32_t *)tmp)[i] = mb->tick[src[i]];
+    memcpy (mb->tick, tmp, n * sizeof *mb->tick);
+    for (i = 0; i < n; ++i) ((uint32_t *)tmp)[i] = mb->length[src[i]];
+    memcpy (mb->length, tmp, n * sizeof *mb->length);
+    for (i = 0; i < n; ++i) ((const uint8_t **)tmp)[i] = mb->payload[src[i]];
+    memcpy ((void *)mb->payload, tmp, n * sizeof *mb->payload);
+    for (i = 0; i < n; ++i) ((uint8_t *)tmp)[i] = mb->status[src[i]];
+    memcpy (mb->status, tmp, n);
+    for (i = 0; i < n; ++i) ((uint8_t *)tmp)[i] = mb->data1[src[i]];
+    memcpy (mb->data1, tmp, n);
+    for (i = 0; i < n; ++i) ((uint8_t *)tmp)[i] = mb->data2[src[i]];
+    memcpy (mb->data2, tmp, n);
+
+    free (perm);
+    free (work);
+    free (tmp);
+    return 0;
+}
+
+static int
+_mb_is_eot (const midi_batch_t *mb, uint32_t i)
+{
+    return mb->status[i] == 0xFF && mb->data1[i] == 0x2F;
+}
+
+/* Encodes everything but the payload of event `i`; returns number of bytes written to `out` (at most 12) */
+static int
+_mb_encode_head (const midi_batch_t *mb, uint32_t i, uint32_t delta, uint8_t *running, uint8_t *out)
+{
+    int n = midi_vlq_encode (delta, out);
+    uint8_t st = mb->status[i];
+
+    if (st < 0xF0)
+    {
+        if (st != *running) out[n++] = st;
+        *running = st;
+        out[n++] = mb->data1[i];
+        if ((st >> 4) != MIDI_PROGRAM && (st >> 4) != MIDI_CHAN_PRESSURE) out[n++] = mb->data2[i];
+        return n;
+    }
+
+    *running = 0; /* meta and sysex cancel running status */
+    out[n++] = st;
+    if (st == 0xFF) out[n++] = mb->data1[i];
+    n += midi_vlq_encode (mb->length[i], out + n);
+    return n;
+}
+
+/* Walks the batch in output order (end of track last), calling `emit` for each chunk of bytes; returns 0, or -1 if
+ * `emit` failed or ticks go backwards */
+static int
+_mb_walk (const midi_batch_t *mb, int (*emit) (void *ctx, const uint8_t *bytes, uint32_t len), void *ctx)
+{
+    uint8_t buf[1024];
+    uint32_t i, k, tick, n = 0, prev = 0, eot_tick = 0, eot = (uint32_t)-1;
+    uint8_t running = 0;
+
+    /* the last round writes the end of track event, if there is one */
+    for (k = 0; k <= mb->count; ++k)
+    {
+        if (k < mb->count)
+        {
+            i = k;
+            tick = mb->tick[i];
+            if (tick < prev) return -1; /* not sorted */
+            if (_mb_is_eot (mb, i))
+            {
+                if (eot == (uint32_t)-1 || tick > eot_tick) eot_tick = tick;
+                eot = i;
+                continue;
+            }
+        }
+        else
+        {
+            if (eot == (uint32_t)-1) break;
+            i = eot;
+            tick = eot_tick > prev ? eot_tick : prev;
+        }
+
+        if (n + 12 > sizeof buf)
+        {
+            if (emit (ctx, buf, n) != 0) return -1;
+            n = 0;
+        }
+
+        n += _mb_encode_head (mb, i, tick - prev, &running, buf + n);
+        prev = tick;
+
+        if (mb->status[i] < 0xF0 || mb->length[i] == 0) continue; /* channel messages have no payload */
+        if (n + mb->length[i] > sizeof buf)
+        {
+            if (emit (ctx, buf, n) != 0) return -1;
+            if (emit (ctx, mb->payload[i], mb->length[i]) != 0) return -1;
+            n = 0;
+        }
+        else
+        {
+            memcpy (buf + n, mb->payload[i], mb->length[i]);
+            n += mb->length[i];
+        }
+    }
+
+    if (n > 0 && emit (ctx, buf, n) != 0) return -1;
+
+    return 0;
+}
+
+static int
+_mb_count (void *ctx, const uint8_t *bytes, uint32_t len)
+{
+    (void)bytes;
+    *(uint32_t *)ctx += len;
+    return 0;
+}
+
+uint32_t
+mb_get_storage_size (const midi_batch_t *mb)
+{
+    uint32_t total = 0;
+
+    if (mb == NULL || _mb_walk (mb, _mb_count, &total) != 0) return 0;
+
+    return total;
+}
+
+typedef struct
+{
+    uint8_t *out;
+    uint32_t n, cap;
+} _mb_sink_t;
+
+static int
+_mb_copy (void *ctx, const uint8_t *bytes, uint32_t len)
+{
+    _mb_sink_t *s = ctx;
+
+    if (len > s->cap - s->n) return -1;
+    memcpy (s->out + s->n, bytes, len);
+    s->n += len;
+    return 0;
+}
+
+int32_t
+mb_encode (const midi_batch_t *mb, uint8_t *out_bytes, uint32_t cap)
+{
+    _mb_sink_t s;
+
+    if (mb == NULL || out_bytes == NULL) return -1;
+
+    s.out = out_bytes;
+    s.n = 0;
+    s.cap = cap;
+    if (_mb_walk (mb, _mb_copy, &s) != 0) return -1;
+
+    return s.n;
+}
+
+static int
+_mb_append (void *ctx, const uint8_t *bytes, uint32_t len)
+{
+    return mw_track_append (ctx, bytes, len);
+}
+
+int
+mb_write_track (const midi_batch_t *mb, midi_writer_t *mw)
+{
+    if (mb == NULL || mw == NULL) return -1;
+
+    return _mb_walk (mb, _mb_append, mw);
+}
+
+#endif /* implementation */
+
+#endif /* include guard */
@@ -0,0 +1,540 @@
+/* MIDI-uring - batched whole-file reads and writes on io_uring
+ * This header keeps many MIDI files in flight from a single thread: each file is read (or written) whole with as few
+ * syscalls as possible, and a completion callback gets the complete file contents, ready to be parsed with
+ * `mr_begin_io` or `track_parser_t`.
+ * On kernels without io_uring (or if `io_uring_setup` is blocked), the same API falls back to plain pread / pwrite.
+ * Define `MIDI_URING_NO_URING` to always use the fallback.
+ * The implementation uses POSIX and Linux APIs - compile it with `_GNU_SOURCE` defined before any system header.
+
+ * Example usage
+
+ ```c
+ static void
+ on_read (mu_file_t *f, int status)
+ {
+     if (status != 0) return;
+     // ... f->data holds f->len bytes of the file; it's freed once this function returns ...
+ }
+
+ midi_uring_t mu = { 0 };
+ mu_file_t files[256] = { 0 };
+
+ mu_begin (&mu, 64);
+ for (j = 0; j < nfiles; ++j)
+ {
+     files[j].path = paths[j];
+     files[j].done = on_read;
+     mu_read (&mu, &files[j]);
+ }
+ mu_run (&mu);
+ mu_end (&mu);
+ ```
+ */
+
+#ifndef MIDI_URING_H
+#define MIDI_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MU_READ 0
+#define MU_WRITE 1
+
+/* This structure MUST be zero-initialized before use */
+typedef struct mu_file
+{
+    const char *path; /* file to read from / write to */
+    /* MU_READ: file contents, allocated by `mu_run`; freed after `done` returns, unless `done` sets it to NULL;
+     * MU_WRITE: bytes to write, owned by the caller */
+    uint8_t *data;
+    uint32_t len; /* MU_READ: file size; MU_WRITE: number of bytes to write */
+    /* called once the file has been fully read / written; `status` is 0 on success, -1 on failure */
+    void (*done) (struct mu_file *f, int status);
+    void *user; /* not used by midi-uring */
+    /* internal state */
+    int op, fd;
+    uint32_t off;
+    struct mu_file *next, *prev;
+} mu_file_t;
+
+/* This structure MUST be zero-initialized before use */
+typedef struct
+{
+    int ring_fd;        /* io_uring file descriptor; -1 when using the pread / pwrite fallback */
+    unsigned depth;     /* max number of files in flight */
+    unsigned inflight;  /* number of files in flight */
+    mu_file_t *queue;   /* files waiting to be started */
+    mu_file_t *queue_tail;
+    mu_file_t *active;  /* files in flight */
+    /* mapped rings */
+    void *sq_ring, *cq_ring, *sqes;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *cqes;
+} midi_uring_t;
+
+/* Initializes the context, with room for `depth` files in flight at once;
+ * Falls back to pread / pwrite (without failing) if io_uring can't be set up;
+ * On success returns 0;
+ * On failure (NULL argument, `depth` is 0) returns -1. */
+int mu_begin (midi_uring_t *mu, unsigned depth);
+
+/* Queues `f` to be read whole into a newly allocated buffer; Only `path`, `done` and `user` need to be set;
+ * Nothing is read before `mu_run`. `f` must stay valid until its `done` callback is called;
+ * On success returns 0; On failure (NULL argument) returns -1. */
+int mu_read (midi_uring_t *mu, mu_file_t *f);
+
+/* Queues `f->len` bytes of `f->data` to be written to `f->path` (file is created or truncated);
+ * Nothing is written before `mu_run`. `f` and its data must stay valid until its `done` callback is called;
+ * On success returns 0; On failure (NULL argument) returns -1. */
+int mu_write (midi_uring_t *mu, mu_file_t *f);
+
+/* Runs queued reads and writes until all of them complete, calling `done` for each file as it completes;
+ * Callbacks may queue more files, they are run by the same call;
+ * On success returns number of files that failed (0 if all succeeded);
+ * On failure of the ring itself returns -1. Requests in flight are then cancelled and reaped, their files finished
+ * with status -1, and the ring is released; Queued files stay queued - a later call runs them with pread / pwrite. If
+ * the ring is too broken to reap, the files in flight are still finished, but their read buffers are leaked (`done`
+ * sees `data` NULL), as the kernel may still write to them. */
+int mu_run (midi_uring_t *mu);
+
+/* Releases the ring; Doesn't touch files that are still queued. */
+void mu_end (midi_uring_t *mu);
+
+#ifdef MIDI_URING_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(MIDI_URING_NO_URING)
+#define MIDI_URING_HAVE_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+static int
+_mu_queue (midi_uring_t *mu, mu_file_t *f, int op)
+{
+    if (mu == NULL || f == NULL || f->path == NULL) return -1;
+
+    f->op = op;
+    f->fd = -1;
+    f->off = 0;
+    f->next = NULL;
+
+    if (mu->queue_tail)
+        mu->queue_tail->next = f;
+    else
+        mu->queue = f;
+    mu->queue_tail = f;
+
+    return 0;
+}
+
+int
+mu_read (midi_uring_t *mu, mu_file_t *f)
+{
+    if (f)
+    {
+        f->data = NULL;
+        f->len = 0;
+    }
+    return _mu_queue (mu, f, MU_READ);
+}
+
+int
+mu_write (midi_uring_t *mu, mu_file_t *f)
+{
+    if (f && f->data == NULL && f->len > 0) return -1;
+    return _mu_queue (mu, f, MU_WRITE);
+}
+
+static mu_file_t *
+_mu_pop (midi_uring_t *mu)
+{
+    mu_file_t *f = mu->queue;
+
+    if (f == NULL) return NULL;
+    mu->queue = f->next;
+    if (mu->queue == NULL) mu->queue_tail = NULL;
+    f->next = NULL;
+
+    return f;
+}
+
+/* Opens the file, and allocates the read buffer */
+static int
+_mu_open (mu_file_t *f)
+{
+    struct stat st;
+
+    if (f->op == MU_WRITE)
+    {
+        f->fd = open (f->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        return f->fd < 0 ? -1 : 0;
+    }
+
+    if ((f->fd = open (f->path, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+    if (fstat (f->fd, &st) != 0 || st.st_size > (off_t)UINT32_MAX) return -1;
+
+    f->len = st.st_size;
+    if ((f->data = malloc (f->len ? f->len : 1)) == NULL) return -1;
+
+    return 0;
+}
+
+static int
+_mu_finish (mu_file_t *f, int status)
+{
+    if (f->fd >= 0) close (f->fd);
+    f->fd = -1;
+
+    if (f->done) f->done (f, status);
+
+    if (f->op == MU_READ)
+    {
+        free (f->data);
+        f->data = NULL;
+    }
+
+    return status != 0;
+}
+
+/* Reads / writes the rest of the file with plain syscalls; returns 0 or -1 */
+static int
+_mu_sync (mu_file_t *f)
+{
+    ssize_t n;
+
+    while (f->off < f->len)
+    {
+        if (f->op == MU_READ)
+            n = pread (f->fd, f->data + f->off, f->len - f->off, f->off);
+        else
+            n = pwrite (f->fd, f->data + f->off, f->len - f->off, f->off);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        f->off += n;
+    }
+
+    return 0;
+}
+
+static int
+_mu_run_sync (midi_uring_t *mu)
+{
+    mu_file_t *f;
+    int failed = 0;
+
+    while ((f = _mu_pop (mu)) != NULL)
+    {
+        if (_mu_open (f) != 0 || _mu_sync (f) != 0)
+            failed += _mu_finish (f, -1);
+        else
+            failed += _mu_finish (f, 0);
+    }
+
+    return failed;
+}
+
+#ifdef MIDI_URING_HAVE_URING
+
+int
+mu_begin (midi_uring_t *mu, unsigned depth)
+{
+    struct io_uring_params p;
+    uint8_t *sq, *cq;
+    long fd;
+
+    if (mu == NULL || depth == 0) return -1;
+
+    memset (mu, 0, sizeof *mu);
+    mu->ring_fd = -1;
+    mu->depth = depth;
+
+    memset (&p, 0, sizeof p);
+    if ((fd = syscall (__NR_io_uring_setup, depth, &p)) < 0) return 0; /* fallback */
+
+    mu->ring_fd = fd;
+    mu->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+    mu->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+    mu->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (mu->cq_ring_size > mu->sq_ring_size) mu->sq_ring_size = mu->cq_ring_size;
+        mu->cq_ring_size = 0;
+    }
+
+    mu->sq_ring
+        = mmap (NULL, mu->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (mu->sq_ring == MAP_FAILED) goto fallback;
+
+    if (mu->cq_ring_size)
+    {
+        mu->cq_ring = mmap (NULL, mu->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                            IORING_OFF_CQ_RING);
+        if (mu->cq_ring == MAP_FAILED) goto fallback;
+    }
+    else
+        mu->cq_ring = mu->sq_ring;
+
+    mu->sqes = mmap (NULL, mu->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (mu->sqes == MAP_FAILED) goto fallback;
+
+    sq = mu->sq_ring;
+    cq = mu->cq_ring;
+    mu->sq_head = (unsigned *)(sq + p.sq_off.head);
+    mu->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    mu->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    mu->sq_array = (unsigned *)(sq + p.sq_off.array);
+    mu->cq_head = (unsigned *)(cq + p.cq_off.head);
+    mu->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    mu->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    mu->cqes = cq + p.cq_off.cqes;
+
+    return 0;
+
+fallback:
+    mu_end (mu);
+    mu->depth = depth;
+    return 0;
+}
+
+void
+mu_end (midi_uring_t *mu)
+{
+    if (mu == NULL) return;
+
+    if (mu->sqes && mu->sqes != MAP_FAILED) munmap (mu->sqes, mu->sqes_size);
+    if (mu->cq_ring && mu->cq_ring != MAP_FAILED && mu->cq_ring != mu->sq_ring) munmap (mu->cq_ring, mu->cq_ring_size);
+    if (mu->sq_ring && mu->sq_ring != MAP_FAILED) munmap (mu->sq_ring, mu->sq_ring_size);
+    if (mu->ring_fd >= 0) close (mu->ring_fd);
+
+    mu->sqes = mu->cq_ring = mu->sq_ring = NULL;
+    mu->ring_fd = -1;
+}
+
+/* Queues a read / write of the rest of the file; the submission ring always has room, as each file in flight has at
+ * most one request outstanding */
+static void
+_mu_push (midi_uring_t *mu, mu_file_t *f)
+{
+    unsigned tail = *mu->sq_tail;
+    unsigned idx = tail & *mu->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)mu->sqes + idx;
+
+    memset (sqe, 0, sizeof *sqe);
+    sqe->opcode = f->op == MU_READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = f->fd;
+    sqe->addr = (uintptr_t)(f->data + f->off);
+    sqe->len = f->len - f->off;
+    sqe->off = f->off;
+    sqe->user_data = (uintptr_t)f;
+
+    mu->sq_array[idx] = idx;
+    __atomic_store_n (mu->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void
+_mu_link (midi_uring_t *mu, mu_file_t *f)
+{
+    f->prev = NULL;
+    f->next = mu->active;
+    if (mu->active) mu->active->prev = f;
+    mu->active = f;
+}
+
+static void
+_mu_unlink (midi_uring_t *mu, mu_file_t *f)
+{
+    if (f->prev)
+        f->prev->next = f->next;
+    else
+        mu->active = f->next;
+    if (f->next) f->next->prev = f->prev;
+    f->next = f->prev = NULL;
+}
+
+/* Cancels the requests still in flight on a failed ring, reaps their completions, and fails their files; Then releases
+ * the ring. Closing the ring does not wait for requests the kernel has already started (e.g. reads handed to io-wq), so
+ * each one is reaped before its buffer is freed. If the ring can't be reaped, the read buffers of the files left are
+ * leaked instead - the kernel may still write to them. Returns -1. */
+static int
+_mu_abort (midi_uring_t *mu)
+{
+    struct io_uring_cqe *cqe;
+    struct io_uring_sqe *sqe;
+    mu_file_t *f, *cancel = mu->active;
+    unsigned head, tail, idx;
+    long ret;
+
+    while (mu->active)
+    {
+        /* one cancel per file in flight, as far as the submission ring has room */
+        tail = *mu->sq_tail;
+        while (cancel && tail - __atomic_load_n (mu->sq_head, __ATOMIC_ACQUIRE) <= *mu->sq_mask)
+        {
+            idx = tail & *mu->sq_mask;
+            sqe = (struct io_uring_sqe *)mu->sqes + idx;
+            memset (sqe, 0, sizeof *sqe);
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = (uintptr_t)cancel; /* `user_data` of the request to cancel */
+            sqe->user_data = 0;            /* not a file */
+            mu->sq_array[idx] = idx;
+            tail += 1;
+            cancel = cancel->next;
+        }
+        __atomic_store_n (mu->sq_tail, tail, __ATOMIC_RELEASE);
+
+        /* also submits reads / writes queued but not submitted yet; they complete, or get cancelled, like the rest */
+        ret = syscall (__NR_io_uring_enter, mu->ring_fd, tail - __atomic_load_n (mu->sq_head, __ATOMIC_ACQUIRE), 1,
+                       IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) break;
+
+        /* each file gets exactly one completion, whether its request finished, failed or was cancelled */
+        head = *mu->cq_head;
+        while (head != __atomic_load_n (mu->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            cqe = (struct io_uring_cqe *)mu->cqes + (head & *mu->cq_mask);
+            head += 1;
+            if (cqe->user_data == 0) continue; /* result of a cancel */
+
+            f = (mu_file_t *)(uintptr_t)cqe->user_data;
+            if (f == cancel) cancel = f->next;
+            _mu_unlink (mu, f);
+            _mu_finish (f, -1);
+        }
+        __atomic_store_n (mu->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    /* the ring can't be reaped - fail the files left, but leak their read buffers */
+    while ((f = mu->active) != NULL)
+    {
+        _mu_unlink (mu, f);
+        if (f->op == MU_READ) f->data = NULL;
+        _mu_finish (f, -1);
+    }
+
+    mu_end (mu);
+    mu->inflight = 0;
+
+    return -1;
+}
+
+int
+mu_run (midi_uring_t *mu)
+{
+    struct io_uring_cqe *cqe;
+    mu_file_t *f;
+    unsigned head, to_submit = 0;
+    long ret;
+    int failed = 0, res;
+
+    if (mu == NULL) return -1;
+    if (mu->ring_fd < 0) return _mu_run_sync (mu);
+
+    for (;;)
+    {
+        while (mu->inflight < mu->depth && (f = _mu_pop (mu)) != NULL)
+        {
+            if (_mu_open (f) != 0)
+                failed += _mu_finish (f, -1);
+            else if (f->len == 0)
+                failed += _mu_finish (f, 0);
+            else
+            {
+                _mu_push (mu, f);
+                _mu_link (mu, f);
+                mu->inflight += 1;
+                to_submit += 1;
+            }
+        }
+
+        if (mu->inflight == 0) break;
+
+        ret = syscall (__NR_io_uring_enter, mu->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            return _mu_abort (mu);
+        }
+        to_submit -= ret;
+
+        head = *mu->cq_head;
+        while (head != __atomic_load_n (mu->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            cqe = (struct io_uring_cqe *)mu->cqes + (head & *mu->cq_mask);
+            f = (mu_file_t *)(uintptr_t)cqe->user_data;
+            res = cqe->res;
+            head += 1;
+
+            if (res == -EINTR || res == -EAGAIN)
+            {
+                _mu_push (mu, f);
+                to_submit += 1;
+                continue;
+            }
+
+            if (res == -EINVAL || res == -EOPNOTSUPP) /* kernel without IORING_OP_READ / WRITE */
+                res = _mu_sync (f) == 0 ? 0 : -1;
+            else if (res <= 0)
+                res = -1;
+            else if ((f->off += res) < f->len)
+            {
+                _mu_push (mu, f); /* short read / write */
+                to_submit += 1;
+                continue;
+            }
+            else
+                res = 0;
+
+            mu->inflight -= 1;
+            _mu_unlink (mu, f);
+            failed += _mu_finish (f, res);
+        }
+        __atomic_store_n (mu->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return failed;
+}
+
+#else /* no io_uring */
+
+int
+mu_begin (midi_uring_t *mu, unsigned depth)
+{
+    if (mu == NULL || depth == 0) return -1;
+
+    memset (mu, 0, sizeof *mu);
+    mu->ring_fd = -1;
+    mu->depth = depth;
+
+    return 0;
+}
+
+void
+mu_end (midi_uring_t *mu)
+{
+    (void)mu;
+}
+
+int
+mu_run (midi_uring_t *mu)
+{
+    if (mu == NULL) return -1;
+    return _mu_run_sync (mu);
+}
+
+#endif
+
+#endif /* implementation */
+
+#endif /* include guard */
@@ -5,17 +5,26 @@
 #define MIDI_FMT_MTRACK 1
 #define MIDI_FMT_MSONG 2
 
+#include "midi-io.h"
+
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 /* This structure MUST be zero-initialized before use */
 typedef struct
 {
     /* writer state */
-    FILE *dst;  /* destination file */
-    uint32_t i; /* current file offset */
+    midi_io_t io; /* destination */
+    FILE *dst;    /* destination file, if started with `mw_begin`; NULL otherwise */
+    uint32_t i;   /* current file offset */
     /* header info */
-    uint16_t ntracks; /* count of `mw_track_begin` calls */
+    uint16_t ntracks;   /* count of `mw_track_begin` calls */
+    uint16_t ntracks_s; /* number of tracks promised to `mw_begin_stream`; 0 if started otherwise */
+    /* track buffer, used instead of seeking back when started with `mw_begin_stream` */
+    uint8_t *buf;
+    uint32_t buf_len, buf_cap;
     /* track info */
     uint32_t track_offset; /* file offset to begining of event data section of current track */
     /* [ MTrk:4 ][ Track-len:4 ][ Track data:... ] */
@@ -28,6 +37,16 @@ typedef struct
  * On failure (write failed, NULL argument), returns -1, without setting any error indicator; */
 int mw_begin (midi_writer_t *mw, FILE *dst, uint16_t format, uint16_t tickdiv);
 
+/* Same as `mw_begin`, but writes through `io` instead of a file; `io` is copied into the writer context.
+ * `io->write` and `io->seek` are both required - use `mw_begin_stream` for destinations that can't seek. */
+int mw_begin_io (midi_writer_t *mw, const midi_io_t *io, uint16_t format, uint16_t tickdiv);
+
+/* Same as `mw_begin_io`, for destinations without `io->seek` (pipes, sockets, compressors, ...);
+ * As the header can't be patched later, number of tracks must be known up front. Each track is buffered in memory
+ * (allocated with `realloc`) until `mw_track_end` writes it out, so nothing is ever written twice;
+ * `mw_end` fails if the number of tracks written differs from `ntracks`, and frees the track buffer. */
+int mw_begin_stream (midi_writer_t *mw, const midi_io_t *io, uint16_t format, uint16_t ntracks, uint16_t tickdiv);
+
 /* Filnalizes MIDI file, by updating the placeholder data in the MIDI header.
  * This function does not end current track, nor checks if the MIDI header has been written, so make sure appropriate
  * functions have been called before calling this function;
@@ -60,6 +79,37 @@ int mw_track_end (midi_writer_t *mw);
 
 #ifdef MIDI_WRITER_H
 
+static int32_t
+_mw_file_write (void *ctx, const uint8_t *buf, uint32_t len)
+{
+    size_t n = fwrite (buf, 1, len, ctx);
+    if (n == 0 && ferror ((FILE *)ctx)) return -1;
+    return n;
+}
+
+static int
+_mw_file_seek (void *ctx, uint32_t offset)
+{
+    return fseek (ctx, offset, SEEK_SET);
+}
+
+/* Writes all `len` bytes, unless destination fails; returns number of bytes written */
+static uint32_t
+_mw_write (midi_writer_t *mw, const uint8_t *buf, uint32_t len)
+{
+    uint32_t total = 0;
+    int32_t n;
+
+    while (total < len)
+    {
+        if ((n = mw->io.write (mw->io.ctx, buf + total, len - total)) <= 0) break;
+        total += n;
+    }
+
+    mw->i += total;
+    return total;
+}
+
 static int
 _mw_write_u32 (midi_writer_t *mw, uint32_t u32)
 {
@@ -71,8 +121,7 @@ _mw_write_u32 (midi_writer_t *mw, uint32_t u32)
     b[2] = u32 >> 8;
     b[3] = u32;
 
-    n = fwrite (b, sizeof *b, 4, mw->dst);
-    mw->i += n;
+    n = _mw_write (mw, b, 4);
     return n - 4;
 }
 
@@ -85,20 +134,41 @@ _mw_write_u16 (midi_writer_t *mw, uint16_t u16)
     b[0] = u16 >> 8;
     b[1] = u16;
 
-    n = fwrite (b, sizeof *b, 2, mw->dst);
-    mw->i += n;
+    n = _mw_write (mw, b, 2);
     return n - 2;
 }
 
 int
 mw_begin (midi_writer_t *mw, FILE *dst, uint16_t format, uint16_t tickdiv)
 {
+    midi_io_t io;
+
     if (!mw) return -1;
     if (!dst) return -1;
 
+    io.read = NULL;
+    io.write = _mw_file_write;
+    io.seek = _mw_file_seek;
+    io.size = NULL;
+    io.ctx = dst;
+
+    if (mw_begin_io (mw, &io, format, tickdiv) != 0) return -1;
     mw->dst = dst;
+
+    return 0;
+}
+
+int
+mw_begin_io (midi_writer_t *mw, const midi_io_t *io, uint16_t format, uint16_t tickdiv)
+{
+    if (!mw) return -1;
+    if (!io || !io->write || !io->seek) return -1;
+
+    mw->io = *io;
+    mw->dst = NULL;
     mw->i = 0;
     mw->ntracks = 0;
+    mw->ntracks_s = 0;
 
     if (_mw_write_u32 (mw, 0x4d546864) != 0) return -1; /* magic */
     if (_mw_write_u32 (mw, 6) != 0) return -1;          /* header length */
@@ -109,11 +179,40 @@ mw_begin (midi_writer_t *mw, FILE *dst, uint16_t format, uint16_t tickdiv)
     return 0;
 }
 
+int
+mw_begin_stream (midi_writer_t *mw, const midi_io_t *io, uint16_t format, uint16_t ntracks, uint16_t tickdiv)
+{
+    if (!mw) return -1;
+    if (!io || !io->write || ntracks == 0) return -1;
+
+    mw->io = *io;
+    mw->dst = NULL;
+    mw->i = 0;
+    mw->ntracks = 0;
+    mw->ntracks_s = ntracks;
+    mw->buf_len = 0;
+
+    if (_mw_write_u32 (mw, 0x4d546864) != 0) return -1; /* magic */
+    if (_mw_write_u32 (mw, 6) != 0) return -1;          /* header length */
+    if (_mw_write_u16 (mw, format) != 0) return -1;     /* format */
+    if (_mw_write_u16 (mw, ntracks) != 0) return -1;    /* ntracks */
+    if (_mw_write_u16 (mw, tickdiv) != 0) return -1;    /* tickdiv */
+
+    return 0;
+}
+
 int
 mw_track_begin (midi_writer_t *mw)
 {
     if (!mw) return -1;
 
+    if (mw->ntracks_s)
+    {
+        mw->buf_len = 0;
+        mw->track_offset = mw->i + 8;
+        return 0;
+    }
+
     if (_mw_write_u32 (mw, 0x4d54726b) != 0) return -1; /* magic */
     if (_mw_write_u32 (mw, 0xFAFAFAFA) != 0) return -1; /* track_len (placeholder) */
 
@@ -125,15 +224,37 @@ mw_track_begin (midi_writer_t *mw)
 int
 mw_track_append (midi_writer_t *mw, const uint8_t *data, uint32_t len)
 {
+    uint32_t saved_i;
+
     if (!mw) return -1;
     if (!data || len == 0) return -1;
 
-    if (fwrite (data, sizeof *data, len, mw->dst) != len)
+    if (mw->ntracks_s)
     {
-        fseek (mw->dst, mw->i, SEEK_SET);
+        if (len > 0xFFFFFFFFU - mw->buf_len) return -1;
+        if (mw->buf_len + len > mw->buf_cap)
+        {
+            uint32_t cap = mw->buf_cap ? mw->buf_cap : 4096;
+            void *p;
+
+            while (cap < mw->buf_len + len) cap = cap > 0x7FFFFFFFU ? 0xFFFFFFFFU : cap * 2;
+            if ((p = realloc (mw->buf, cap)) == NULL) return -1;
+            mw->buf = p;
+            mw->buf_cap = cap;
+        }
+
+        memcpy (mw->buf + mw->buf_len, data, len);
+        mw->buf_len += len;
+        return 0;
+    }
+
+    saved_i = mw->i;
+    if (_mw_write (mw, data, len) != len)
+    {
+        mw->io.seek (mw->io.ctx, saved_i);
+        mw->i = saved_i;
         return -1;
     }
-    mw->i += len;
 
     return 0;
 }
@@ -146,20 +267,29 @@ mw_track_end (midi_writer_t *mw)
 
     if (!mw) return -1;
 
+    if (mw->ntracks_s)
+    {
+        if (_mw_write_u32 (mw, 0x4d54726b) != 0) return -1; /* magic */
+        if (_mw_write_u32 (mw, mw->buf_len) != 0) return -1; /* track_len */
+        if (mw->buf_len && _mw_write (mw, mw->buf, mw->buf_len) != mw->buf_len) return -1;
+        mw->ntracks += 1;
+        return 0;
+    }
+
     saved_i = mw->i;
 
-    if (fseek (mw->dst, mw->track_offset - 4, SEEK_SET) != 0) return -1;
+    if (mw->io.seek (mw->io.ctx, mw->track_offset - 4) != 0) return -1;
 
     track_len = saved_i - mw->track_offset;
 
     if (_mw_write_u32 (mw, track_len) != 0)
     {
-        fseek (mw->dst, saved_i, SEEK_SET);
+        mw->io.seek (mw->io.ctx, saved_i);
         return -1;
     }
 
     mw->i = saved_i;
-    if (fseek (mw->dst, saved_i, SEEK_SET) != 0) return -1;
+    if (mw->io.seek (mw->io.ctx, saved_i) != 0) return -1;
     mw->ntracks += 1;
 
     return 0;
@@ -169,9 +299,16 @@ int
 mw_end (midi_writer_t *mw)
 {
     if (!mw) return -1;
-    if (mw->dst)
+    if (mw->ntracks_s)
+    {
+        free (mw->buf);
+        mw->buf = NULL;
+        mw->buf_len = mw->buf_cap = 0;
+        return mw->ntracks == mw->ntracks_s ? 0 : -1;
+    }
+    if (mw->io.write)
     {
-        fseek (mw->dst, 10, SEEK_SET);
+        if (mw->io.seek (mw->io.ctx, 10) != 0) return -1;
         if (_mw_write_u16 (mw, mw->ntracks) != 0) return -1;
     }
     return 0;